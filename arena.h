@@ -0,0 +1,142 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <charconv>
+#include <memory_resource>
+#include <new>
+#include <string_view>
+#include <vector>
+#include "common.h"
+
+// Bump allocator for data that only lives until the end of the current tick:
+// outgoing message text, event lists and scratch vectors. Deallocation is a
+// no-op and reset() rewinds the whole arena at once. Requests that do not fit
+// get their own heap block until the next reset, which then grows the main
+// block so a steady workload stops touching the heap entirely.
+class TickArena : public std::pmr::memory_resource {
+private:
+    char* base;
+    size_t capacity;
+    size_t used;
+    std::vector<void*> overflow;
+    size_t overflowBytes;
+
+protected:
+    void* do_allocate(size_t bytes, size_t alignment) override {
+        uintptr_t start = reinterpret_cast<uintptr_t>(base) + used;
+        size_t padding = (alignment - start % alignment) % alignment;
+        if (used + padding + bytes <= capacity) {
+            used += padding + bytes;
+            return base + (used - bytes);
+        }
+
+        char* block = static_cast<char*>(::operator new(bytes + alignment));
+        overflow.push_back(block);
+        overflowBytes += bytes + alignment;
+        uintptr_t blockStart = reinterpret_cast<uintptr_t>(block);
+        return block + (alignment - blockStart % alignment) % alignment;
+    }
+
+    void do_deallocate(void*, size_t, size_t) override {
+    }
+
+    bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override {
+        return this == &other;
+    }
+
+public:
+    explicit TickArena(size_t initialCapacity = TICK_ARENA_BYTES)
+        : base(static_cast<char*>(::operator new(initialCapacity))), capacity(initialCapacity),
+          used(0), overflow(), overflowBytes(0) {
+        overflow.reserve(16);
+    }
+
+    ~TickArena() override {
+        reset();
+        ::operator delete(base);
+    }
+
+    TickArena(const TickArena&) = delete;
+    TickArena& operator=(const TickArena&) = delete;
+
+    // Forget everything allocated this tick; only call once nothing refers to it
+    void reset() {
+        for (void* block : overflow) {
+            ::operator delete(block);
+        }
+        overflow.clear();
+
+        if (overflowBytes > 0) {
+            size_t newCapacity = 2 * (capacity + overflowBytes);
+            ::operator delete(base);
+            base = static_cast<char*>(::operator new(newCapacity));
+            capacity = newCapacity;
+            overflowBytes = 0;
+        }
+        used = 0;
+    }
+
+    char* allocateChars(size_t count) {
+        return static_cast<char*>(allocate(count, 1));
+    }
+};
+
+// The calling thread's arena. The network and game threads each reset their
+// own at the end of every burst or tick.
+inline TickArena& tickArena() {
+    thread_local TickArena arena;
+    return arena;
+}
+
+// Formats one protocol message into arena memory with std::to_chars. The
+// capacity is fixed up front; anything past it is cut off.
+class MessageBuilder {
+private:
+    char* begin;
+    char* cursor;
+    char* end;
+
+public:
+    MessageBuilder(TickArena& arena, size_t capacity)
+        : begin(arena.allocateChars(capacity)), cursor(begin), end(begin + capacity) {}
+
+    MessageBuilder& operator<<(std::string_view text) {
+        size_t count = std::min<size_t>(text.size(), end - cursor);
+        memcpy(cursor, text.data(), count);
+        cursor += count;
+        return *this;
+    }
+
+    MessageBuilder& operator<<(char c) {
+        if (cursor < end) {
+            *cursor++ = c;
+        }
+        return *this;
+    }
+
+    MessageBuilder& operator<<(int value) {
+        std::to_chars_result result = std::to_chars(cursor, end, value);
+        if (result.ec == std::errc()) {
+            cursor = result.ptr;
+        }
+        return *this;
+    }
+
+    MessageBuilder& operator<<(size_t value) {
+        std::to_chars_result result = std::to_chars(cursor, end, value);
+        if (result.ec == std::errc()) {
+            cursor = result.ptr;
+        }
+        return *this;
+    }
+
+    std::string_view view() const {
+        return std::string_view(begin, cursor - begin);
+    }
+};
+
+#endif // ARENA_H
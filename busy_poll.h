@@ -0,0 +1,133 @@
+#ifndef BUSY_POLL_H
+#define BUSY_POLL_H
+
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <pthread.h>
+#include <sched.h>
+#include <cerrno>
+#include <cstring>
+#include <chrono>
+#include <iostream>
+#include <string>
+#include "common.h"
+
+// Pin a thread to one CPU so the scheduler never migrates it
+inline bool pinThreadToCpu(pthread_t thread, int cpu) {
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    int err = pthread_setaffinity_np(thread, sizeof(set), &set);
+    if (err != 0) {
+        std::cerr << "Error pinning thread to CPU " << cpu << ": " << strerror(err) << std::endl;
+        return false;
+    }
+    return true;
+}
+
+// Tell the core we are spinning, without giving up the CPU
+inline void cpuRelax() {
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#elif defined(__aarch64__)
+    asm volatile("yield");
+#endif
+}
+
+// Spinning receive path for UDPServer's plain-socket backend. Instead of
+// sleeping in select() it keeps calling non-blocking recvmmsg, draining up
+// to BUSY_POLL_BATCH datagrams per syscall into a local batch that later
+// receives are served from. With SO_BUSY_POLL the kernel additionally polls
+// the device queue inside each recvmmsg. Burns its whole CPU by design.
+class BusyPollReceiver {
+private:
+    int sockfd;
+    struct mmsghdr headers[BUSY_POLL_BATCH];
+    struct iovec iovecs[BUSY_POLL_BATCH];
+    struct sockaddr_in addrs[BUSY_POLL_BATCH];
+    char buffers[BUSY_POLL_BATCH][MAX_BUFFER_SIZE];
+    int batchCount;
+    int batchNext;
+
+    // One non-blocking recvmmsg; returns false if nothing was waiting
+    bool refill() {
+        for (int i = 0; i < BUSY_POLL_BATCH; i++) {
+            headers[i].msg_hdr.msg_namelen = sizeof(addrs[i]);
+        }
+
+        int count = recvmmsg(sockfd, headers, BUSY_POLL_BATCH, MSG_DONTWAIT, nullptr);
+        if (count <= 0) {
+            return false;
+        }
+        batchCount = count;
+        batchNext = 0;
+        return true;
+    }
+
+    bool pop(std::string& message, struct sockaddr_in& addr, socklen_t& addrLen) {
+        if (batchNext >= batchCount) {
+            return false;
+        }
+        int i = batchNext++;
+        message.assign(buffers[i], headers[i].msg_len);
+        addr = addrs[i];
+        addrLen = sizeof(addr);
+        return true;
+    }
+
+public:
+    BusyPollReceiver() : sockfd(-1), batchCount(0), batchNext(0) {}
+
+    BusyPollReceiver(const BusyPollReceiver&) = delete;
+    BusyPollReceiver& operator=(const BusyPollReceiver&) = delete;
+
+    // Set up the batch for a bound non-blocking socket. busyPollUsec > 0 also
+    // sets SO_BUSY_POLL, which may need CAP_NET_ADMIN; failing that is not fatal.
+    void init(int _sockfd, int busyPollUsec) {
+        sockfd = _sockfd;
+        memset(headers, 0, sizeof(headers));
+        for (int i = 0; i < BUSY_POLL_BATCH; i++) {
+            iovecs[i].iov_base = buffers[i];
+            iovecs[i].iov_len = MAX_BUFFER_SIZE;
+            headers[i].msg_hdr.msg_iov = &iovecs[i];
+            headers[i].msg_hdr.msg_iovlen = 1;
+            headers[i].msg_hdr.msg_name = &addrs[i];
+        }
+
+        if (busyPollUsec > 0 &&
+            setsockopt(sockfd, SOL_SOCKET, SO_BUSY_POLL, &busyPollUsec, sizeof(busyPollUsec)) < 0) {
+            std::cerr << "Error setting SO_BUSY_POLL (" << strerror(errno)
+                      << "), spinning in user space only" << std::endl;
+        }
+    }
+
+    // Spin until a datagram arrives or timeoutMs passes. Every few hundred
+    // empty polls check the clock and yield, which is nearly free on a
+    // dedicated core but lets anything sharing the CPU run.
+    bool receive(std::string& message, struct sockaddr_in& addr, socklen_t& addrLen, int timeoutMs) {
+        if (pop(message, addr, addrLen) || (refill() && pop(message, addr, addrLen))) {
+            return true;
+        }
+
+        auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeoutMs);
+        for (unsigned polls = 1;; polls++) {
+            cpuRelax();
+            if (refill()) {
+                return pop(message, addr, addrLen);
+            }
+            if (polls % 256 == 0) {
+                if (std::chrono::steady_clock::now() >= deadline) {
+                    return false;
+                }
+                sched_yield();
+            }
+        }
+    }
+
+    // Take a datagram only if one is already here, without spinning
+    bool tryReceive(std::string& message, struct sockaddr_in& addr, socklen_t& addrLen) {
+        return pop(message, addr, addrLen) || (refill() && pop(message, addr, addrLen));
+    }
+};
+
+#endif // BUSY_POLL_H
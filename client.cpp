@@ -4,7 +4,8 @@
     #include <arpa/inet.h>
     #include <sys/socket.h>
     #include <netinet/in.h>
-    #include <thread>
+    #include <poll.h>
+    #include <cerrno>
     #include <atomic>
     #include <sstream>
     #include <map>
@@ -13,6 +14,17 @@
     #include <random>
     #include "common.h"
     #include "udp_helper.h"
+    #include "renderer.h"
+    #include "clock_sync.h"
+    #include "input_sequencer.h"
+
+    // Screen layout: the maze is drawn two columns per cell with a wall border,
+    // the scoreboard sits to its right and two text lines go underneath
+    constexpr int MAP_COLS = (MAZE_WIDTH + 2) * 2;
+    constexpr int MAP_ROWS = MAZE_HEIGHT + 2;
+    constexpr int PANEL_COL = MAP_COLS + 2;
+    constexpr int SCREEN_COLS = PANEL_COL + 24;
+    constexpr int SCREEN_ROWS = MAP_ROWS + 2;
 
     // Terminal control functions
     void enableRawMode() {
@@ -37,11 +49,17 @@
         fcntl(STDIN_FILENO, F_SETFL, flags & ~O_NONBLOCK);
     }
 
-    char readKey() {
+    // Next typed key, or 0 if none is waiting. Sets eof once stdin is closed,
+    // since poll keeps reporting a closed stdin as readable.
+    char readKey(bool& eof) {
         char c = 0;
-        if (read(STDIN_FILENO, &c, 1) == 1) {
+        ssize_t n = read(STDIN_FILENO, &c, 1);
+        if (n == 1) {
             return c;
         }
+        if (n == 0) {
+            eof = true;
+        }
         return 0;
     }
 
@@ -71,24 +89,59 @@
         Position treasure;
         std::map<int, int> playerScores;
         UDPClient* udpClient;
-
-        // Parse position update
+        TerminalRenderer renderer;
+        std::string statusLine;
+        std::string finalMessage;
+        bool dirty;
+        bool spectating;
+        std::string spectateCookie;
+        std::chrono::steady_clock::time_point lastKeepalive;
+        std::string joinCookie;
+        std::chrono::steady_clock::time_point lastJoinSent;
+        uint64_t snapshotTick;
+        std::map<int, Position> otherPlayers;  // From PLAYERS while playing, or snapshots when spectating
+        ClockSync clockSync;
+        InputSequencer inputs;
+
+        // Parse position update, which also acknowledges our inputs
         void handlePositionUpdate(std::istringstream& iss) {
             int id;
             iss >> id;
 
             if (id == playerId) {
+                uint32_t ackSeq;
                 iss >> x >> y;
-                std::cout << "You are now at position (" << x << ", " << y << ")" << std::endl;
+                if (iss >> ackSeq) {
+                    inputs.onAck(ackSeq, std::chrono::steady_clock::now());
+                }
+                dirty = true;
             }
         }
 
+        // Parse everyone's positions; this player is drawn from its own POS
+        void handlePlayersUpdate(std::istringstream& iss) {
+            int playerCount;
+            iss >> playerCount;
+
+            otherPlayers.clear();
+
+            for (int i = 0; i < playerCount; i++) {
+                int id, px, py;
+                iss >> id >> px >> py;
+                if (id != playerId) {
+                    otherPlayers[id] = Position(px, py);
+                }
+            }
+
+            dirty = true;
+        }
+
         // Parse treasure update
         void handleTreasureUpdate(std::istringstream& iss) {
             int tx, ty;
             iss >> tx >> ty;
             treasure = Position(tx, ty);
-            std::cout << "Treasure is at position (" << tx << ", " << ty << ")" << std::endl;
+            dirty = true;
         }
 
         // Parse collection update
@@ -100,10 +153,11 @@
 
             if (id == playerId) {
                 score = newScore;
-                std::cout << "You collected the treasure! Your score: " << score << std::endl;
+                statusLine = "You collected the treasure! Your score: " + std::to_string(score);
             } else {
-                std::cout << "Player " << id << " collected the treasure! Their score: " << newScore << std::endl;
+                statusLine = "Player " + std::to_string(id) + " collected the treasure!";
             }
+            dirty = true;
         }
 
         // Parse scores update
@@ -119,62 +173,128 @@
                 playerScores[id] = playerScore;
             }
 
-            // Find highest score
-            int highestScore = -1;
-            int leaderId = -1;
+            dirty = true;
+        }
 
-            for (const auto& pair : playerScores) {
-                if (pair.second > highestScore) {
-                    highestScore = pair.second;
-                    leaderId = pair.first;
-                }
+        // Parse join challenge and echo the cookie back
+        void handleChallenge(std::istringstream& iss) {
+            std::string cookie;
+            iss >> cookie;
+
+            if (spectating) {
+                spectateCookie = cookie;
+                sendMessage("SPECTATE " + cookie);
+            } else if (playerId == -1) {
+                joinCookie = cookie;
+                sendJoin();
             }
+        }
 
-            std::cout << "Scores: ";
-            for (const auto& pair : playerScores) {
-                std::cout << "Player " << pair.first << ": " << pair.second << "  ";
+        // Echo the server's probe so it can measure RTT and loss
+        void handleProbe(std::istringstream& iss) {
+            std::string seq;
+            iss >> seq;
+            sendMessage("PROBEACK " + seq);
+        }
+
+        // Parse the server's answer to our PING and update the clock estimate
+        void handlePong(std::istringstream& iss) {
+            int64_t t0, t1, t2;
+            if (iss >> t0 >> t1 >> t2 && clockSync.onPong(t0, t1, t2)) {
+                dirty = true;
             }
-            std::cout << std::endl;
+        }
+
+        // Parse spectator confirmation
+        void handleSpectating(std::istringstream& iss) {
+            int intervalMs, delayMs;
+            iss >> intervalMs >> delayMs;
+            statusLine = "Spectating: update every " + std::to_string(intervalMs) + "ms, " +
+                         std::to_string(delayMs) + "ms behind live";
+            dirty = true;
+        }
+
+        // Parse one chunk of a world snapshot; a newer tick replaces the old view
+        void handleSnapshot(std::istringstream& iss) {
+            uint64_t tick;
+            int chunk, chunks, tx, ty, count;
+            iss >> tick >> chunk >> chunks >> tx >> ty >> count;
 
-            if (leaderId != -1) {
-                std::cout << "Leader: Player " << leaderId << " with score " << highestScore << std::endl;
+            if (tick != snapshotTick) {
+                otherPlayers.clear();
+                playerScores.clear();
+                snapshotTick = tick;
             }
 
-            std::cout << "Your score: " << score << std::endl;
+            treasure = Position(tx, ty);
+            for (int i = 0; i < count; i++) {
+                int id, px, py, playerScore;
+                iss >> id >> px >> py >> playerScore;
+                otherPlayers[id] = Position(px, py);
+                playerScores[id] = playerScore;
+            }
+            dirty = true;
         }
 
         // Parse welcome message
         void handleWelcome(std::istringstream& iss) {
             iss >> playerId >> x >> y;
-            std::cout << "Welcome! You are Player " << playerId << " at position (" << x << ", " << y << ")" << std::endl;
+            statusLine = "Welcome! You are Player " + std::to_string(playerId);
+            dirty = true;
         }
 
         // Parse kick message
         void handleKick(std::istringstream& iss) {
             std::string reason;
             std::getline(iss, reason);
-            std::cout << "You have been kicked: " << reason << std::endl;
+            finalMessage = "You have been kicked:" + reason;
             running = false;
         }
 
+        // Our server process went away (a gateway shard restarted) and its
+        // successor does not know us; start over with a fresh JOIN or SPECTATE
+        void handleRejoin() {
+            if (!running) {
+                return; // Already finished, e.g. GAMEOVER from the same shard
+            }
+            if (spectating) {
+                statusLine = "Server restarted, reconnecting as spectator...";
+                spectateCookie.clear();
+                lastKeepalive = std::chrono::steady_clock::now();
+                sendMessage("SPECTATE");
+            } else if (playerId != -1) {
+                statusLine = "Server restarted, rejoining as " + username + "...";
+                playerId = -1;
+                score = 0;
+                playerScores.clear();
+                inputs = InputSequencer();
+                joinCookie.clear();
+                sendJoin();
+            }
+            dirty = true;
+        }
+
         // Parse game over message
         void handleGameOver(std::istringstream& iss) {
             int winnerId, winnerScore;
             iss >> winnerId >> winnerScore;
 
-            std::cout << "Game Over! ";
             if (winnerId == playerId) {
-                std::cout << "You won with a score of " << winnerScore << "!" << std::endl;
+                finalMessage = "Game Over! You won with a score of " + std::to_string(winnerScore) + "!";
             } else {
-                std::cout << "Player " << winnerId << " won with a score of " << winnerScore << "!" << std::endl;
+                finalMessage = "Game Over! Player " + std::to_string(winnerId) + " won with a score of " +
+                               std::to_string(winnerScore) + "!";
             }
 
             running = false;
         }
 
     public:
-        GameClient(const std::string& serverIP = "127.0.0.1", int port = DEFAULT_PORT)
-            : running(false), username(generateRandomUsername()), playerId(-1), x(0), y(0), score(0), treasure(0, 0) {
+        GameClient(const std::string& serverIP = "127.0.0.1", int port = DEFAULT_PORT, bool spectate = false)
+            : running(false), username(generateRandomUsername()), playerId(-1), x(0), y(0), score(0), treasure(0, 0),
+              renderer(SCREEN_COLS, SCREEN_ROWS), dirty(true), spectating(spectate),
+              lastKeepalive(std::chrono::steady_clock::now()), joinCookie(),
+              lastJoinSent(std::chrono::steady_clock::now()), snapshotTick(UINT64_MAX), clockSync(), inputs() {
 
             udpClient = new UDPClient(serverIP, port);
         }
@@ -188,22 +308,110 @@
         void start() {
             running = true;
 
-            std::cout << "Connecting as " << username << "..." << std::endl;
+            renderer.begin();
 
-            // Send join request
-            std::string joinMsg = "JOIN " + username;
-            sendMessage(joinMsg);
+            // Send join request, or subscribe as a spectator
+            if (spectating) {
+                statusLine = "Connecting as spectator...";
+                sendMessage("SPECTATE");
+            } else {
+                statusLine = "Connecting as " + username + "...";
+                sendJoin();
+            }
 
-            // Start message receiving thread
-            std::thread receiveThread(&GameClient::receiveMessages, this);
+            // Serve the socket and keyboard until the game ends
+            eventLoop();
 
-            // Start input handling
-            handleUserInput();
+            // Show the last state, then hand the terminal back
+            drawFrame();
+            renderer.end();
 
-            // Wait for receive thread to finish
-            if (receiveThread.joinable()) {
-                receiveThread.join();
+            if (!finalMessage.empty()) {
+                std::cout << finalMessage << std::endl;
             }
+            printClockSummary();
+        }
+
+        // Draw the maze, scoreboard and status into the renderer and present it
+        void drawFrame() {
+            renderer.clear();
+
+            // Maze border
+            for (int col = 0; col < MAP_COLS; col++) {
+                renderer.put(col, 0, '#', CellColor::DIM);
+                renderer.put(col, MAP_ROWS - 1, '#', CellColor::DIM);
+            }
+            for (int row = 1; row < MAP_ROWS - 1; row++) {
+                renderer.text(0, row, "##", CellColor::DIM);
+                renderer.text(MAP_COLS - 2, row, "##", CellColor::DIM);
+                for (int col = 2; col < MAP_COLS - 2; col += 2) {
+                    renderer.put(col, row, '.', CellColor::DIM);
+                }
+            }
+
+            // Everyone else, as last seen in PLAYERS or a snapshot
+            for (const auto& pair : otherPlayers) {
+                renderer.put(pair.second.x * 2, pair.second.y, 'o', CellColor::CYAN);
+            }
+
+            // Treasure and this player
+            if (treasure.x > 0) {
+                renderer.put(treasure.x * 2, treasure.y, '$', CellColor::YELLOW);
+            }
+            if (playerId != -1) {
+                renderer.put(x * 2, y, '@', CellColor::GREEN);
+            }
+
+            // Scoreboard, leader first
+            int leaderId = -1;
+            int highestScore = -1;
+            for (const auto& pair : playerScores) {
+                if (pair.second > highestScore) {
+                    highestScore = pair.second;
+                    leaderId = pair.first;
+                }
+            }
+
+            renderer.text(PANEL_COL, 0, "Scores", CellColor::CYAN);
+            int row = 1;
+            for (const auto& pair : playerScores) {
+                if (row >= MAP_ROWS - 1) {
+                    break; // Last panel row holds the network line
+                }
+                std::string line = (pair.first == leaderId ? "* " : "  ") + std::string("Player ") +
+                                   std::to_string(pair.first) + ": " + std::to_string(pair.second);
+                renderer.text(PANEL_COL, row++, line,
+                              pair.first == playerId ? CellColor::GREEN : CellColor::DEFAULT);
+            }
+
+            // Network quality against the server, once a PONG has come back
+            if (clockSync.isSynced()) {
+                char netLine[48];
+                snprintf(netLine, sizeof(netLine), "RTT %.1fms clock %+.1fms",
+                         clockSync.getLastRttMs(), clockSync.getOffsetMs());
+                renderer.text(PANEL_COL, MAP_ROWS - 1, netLine, CellColor::DIM);
+            }
+
+            renderer.text(0, MAP_ROWS, spectating ? "Spectating, Q to quit" : "W/A/S/D or arrows to move, Q to quit",
+                          CellColor::DIM);
+            renderer.text(0, MAP_ROWS + 1, statusLine);
+
+            renderer.present();
+            dirty = false;
+        }
+
+        // Round-trip and clock figures for the whole session
+        void printClockSummary() {
+            if (!clockSync.isSynced()) {
+                return;
+            }
+            const RttStats& rtt = clockSync.getRttStats();
+            char summary[128];
+            snprintf(summary, sizeof(summary),
+                     "Round trip min/avg/p99 %.2f/%.2f/%.2fms over %llu pings, server clock offset %+.2fms",
+                     rtt.getMinMs(), rtt.getAvgMs(), rtt.getPercentileMs(0.99),
+                     static_cast<unsigned long long>(rtt.getSamples()), clockSync.getOffsetMs());
+            std::cout << summary << std::endl;
         }
 
         // Send message to server
@@ -211,22 +419,131 @@
             udpClient->sendMessage(message);
         }
 
-        // Receive messages from server
+        // Wait on the socket and stdin together, reacting to whichever is ready
+        void eventLoop() {
+            enableRawMode();
+
+            struct pollfd fds[2];
+            fds[0].fd = STDIN_FILENO;
+            fds[0].events = POLLIN;
+            fds[1].fd = udpClient->getSocket();
+            fds[1].events = POLLIN;
+
+            while (running) {
+                // Sleep until input arrives, or until a pending frame may be drawn
+                int timeoutMs = dirty ? renderer.msUntilFrame(std::chrono::steady_clock::now()) : -1;
+                if (spectating) {
+                    int keepaliveMs = SPECTATOR_KEEPALIVE_SECONDS * 1000;
+                    timeoutMs = timeoutMs < 0 ? keepaliveMs : std::min(timeoutMs, keepaliveMs);
+                } else if (playerId != -1) {
+                    auto now = std::chrono::steady_clock::now();
+                    int pingMs = clockSync.msUntilPing(now);
+                    timeoutMs = timeoutMs < 0 ? pingMs : std::min(timeoutMs, pingMs);
+
+                    int resendMs = inputs.msUntilResend(now);
+                    if (resendMs >= 0) {
+                        timeoutMs = std::min(timeoutMs, resendMs);
+                    }
+                } else {
+                    timeoutMs = timeoutMs < 0 ? JOIN_RETRY_MS : std::min(timeoutMs, JOIN_RETRY_MS);
+                }
+                int ready = poll(fds, 2, timeoutMs);
+
+                if (ready < 0) {
+                    if (errno == EINTR) {
+                        continue;
+                    }
+                    std::cerr << "Poll error" << std::endl;
+                    break;
+                }
+
+                if (fds[1].revents & POLLIN) {
+                    receiveMessages();
+                }
+
+                if (fds[0].revents & POLLIN) {
+                    if (!handleUserInput()) {
+                        fds[0].fd = -1; // stdin at EOF, keep serving the socket
+                    }
+                } else if (fds[0].revents & POLLHUP) {
+                    fds[0].fd = -1; // stdin closed, keep serving the socket
+                }
+
+                if (dirty && renderer.frameDue(std::chrono::steady_clock::now())) {
+                    drawFrame();
+                }
+
+                if (spectating) {
+                    sendKeepalive();
+                } else if (playerId != -1) {
+                    auto now = std::chrono::steady_clock::now();
+                    std::string pingMsg;
+                    if (clockSync.pollPing(now, pingMsg)) {
+                        sendMessage(pingMsg);
+                    }
+
+                    // No ack yet: the last MOVE may be lost, repeat the pending inputs
+                    if (inputs.resendDue(now)) {
+                        sendMessage(inputs.buildMove(playerId, now));
+                    }
+                } else if (std::chrono::steady_clock::now() - lastJoinSent >=
+                           std::chrono::milliseconds(JOIN_RETRY_MS)) {
+                    // The JOIN, its CHALLENGE or our echo may have been lost
+                    sendJoin();
+                }
+            }
+
+            disableRawMode();
+        }
+
+        // JOIN, echoing the cookie once the server has challenged us. A stale
+        // cookie just earns a fresh CHALLENGE.
+        void sendJoin() {
+            lastJoinSent = std::chrono::steady_clock::now();
+            sendMessage(joinCookie.empty() ? "JOIN " + username : "JOIN " + username + " " + joinCookie);
+        }
+
+        // Spectators repeat SPECTATE so the relay keeps sending to them
+        void sendKeepalive() {
+            auto now = std::chrono::steady_clock::now();
+            if (now - lastKeepalive < std::chrono::seconds(SPECTATOR_KEEPALIVE_SECONDS)) {
+                return;
+            }
+            lastKeepalive = now;
+            sendMessage(spectateCookie.empty() ? "SPECTATE" : "SPECTATE " + spectateCookie);
+        }
+
+        // Handle every datagram already queued on the socket, up to a burst limit
         void receiveMessages() {
             std::string message;
 
-            while (running) {
-                if (udpClient->receiveMessage(message)) {
-                    processServerMessage(message);
+            for (int i = 0; i < MAX_RECEIVE_BURST && running; i++) {
+                if (!udpClient->tryReceiveMessage(message)) {
+                    break;
+                }
+                processServerMessage(message);
+            }
+        }
+
+        // Unpack a datagram from the server, which may bundle several messages
+        void processServerMessage(const std::string& datagram) {
+            size_t start = 0;
+
+            while (start < datagram.size()) {
+                size_t end = datagram.find('\n', start);
+                if (end == std::string::npos) {
+                    end = datagram.size();
                 }
 
-                // Small sleep to prevent CPU hogging
-                std::this_thread::sleep_for(std::chrono::milliseconds(10));
+                if (end > start) {
+                    processServerLine(datagram.substr(start, end - start));
+                }
+                start = end + 1;
             }
         }
 
-        // Process message from server
-        void processServerMessage(const std::string& message) {
+        // Dispatch a single message from the server
+        void processServerLine(const std::string& message) {
             std::istringstream iss(message);
             std::string type;
             iss >> type;
@@ -239,46 +556,57 @@
                 handleCollectionUpdate(iss);
             } else if (type == "SCORES") {
                 handleScoresUpdate(iss);
+            } else if (type == "PLAYERS") {
+                handlePlayersUpdate(iss);
+            } else if (type == "PROBE") {
+                handleProbe(iss);
+            } else if (type == "PONG") {
+                handlePong(iss);
+            } else if (type == "CHALLENGE") {
+                handleChallenge(iss);
             } else if (type == "WELCOME") {
                 handleWelcome(iss);
+            } else if (type == "SPECTATING") {
+                handleSpectating(iss);
+            } else if (type == "SNAPSHOT") {
+                handleSnapshot(iss);
             } else if (type == "KICK") {
                 handleKick(iss);
+            } else if (type == "REJOIN") {
+                handleRejoin();
             } else if (type == "GAMEOVER") {
                 handleGameOver(iss);
             }
         }
 
-        // Handle user input
-        void handleUserInput() {
-            std::cout << "Game controls: W (up), A (left), S (down), D (right), Q (quit)" << std::endl;
-
-            enableRawMode();
-
-            while (running) {
-                char input = readKey();
+        // Handle every key already typed; returns false once stdin is at EOF
+        bool handleUserInput() {
+            char input;
+            bool eof = false;
 
+            while (running && (input = readKey(eof)) != 0) {
                 if (input == 'Q' || input == 'q') {
                     running = false;
                     break;
                 }
 
-                std::string direction;
+                char direction = 0;  // Sent as W/A/S/D
                 switch (input) {
                     case 'W':
                     case 'w':
-                        direction = "UP";
+                        direction = 'W';
                         break;
                     case 'A':
                     case 'a':
-                        direction = "LEFT";
+                        direction = 'A';
                         break;
                     case 'S':
                     case 's':
-                        direction = "DOWN";
+                        direction = 'S';
                         break;
                     case 'D':
                     case 'd':
-                        direction = "RIGHT";
+                        direction = 'D';
                         break;
                     // Handle arrow keys (they send escape sequences)
                     case 27: // ESC
@@ -286,16 +614,16 @@
                             if (read(STDIN_FILENO, &input, 1) == 1) {
                                 switch (input) {
                                     case 'A': // Up arrow
-                                        direction = "UP";
+                                        direction = 'W';
                                         break;
                                     case 'B': // Down arrow
-                                        direction = "DOWN";
+                                        direction = 'S';
                                         break;
                                     case 'C': // Right arrow
-                                        direction = "RIGHT";
+                                        direction = 'D';
                                         break;
                                     case 'D': // Left arrow
-                                        direction = "LEFT";
+                                        direction = 'A';
                                         break;
                                 }
                             }
@@ -306,28 +634,38 @@
                         break;
                 }
 
-                if (!direction.empty() && playerId != -1) {
-                    std::string moveMsg = "MOVE " + std::to_string(playerId) + " " + direction;
-                    sendMessage(moveMsg);
+                // Numbered, and sent along with every input not yet acknowledged
+                if (direction != 0 && playerId != -1) {
+                    inputs.push(direction);
+                    sendMessage(inputs.buildMove(playerId, std::chrono::steady_clock::now()));
                 }
-
-                // Small sleep to prevent CPU hogging
-                std::this_thread::sleep_for(std::chrono::milliseconds(10));
             }
-
-            disableRawMode();
+            return !eof;
         }
     };
 
     int main(int argc, char* argv[]) {
         std::string serverIP = "127.0.0.1";  // Default to localhost
-
-        // If server IP is provided, use it
-        if (argc > 1) {
-            serverIP = argv[1];
+        int port = DEFAULT_PORT;
+        bool spectate = false;
+
+        // Optional server IP, then an optional port (e.g. to go through
+        // netem_proxy); --spectate watches instead of playing
+        int positional = 0;
+        for (int i = 1; i < argc; i++) {
+            std::string arg = argv[i];
+
+            if (arg == "--spectate") {
+                spectate = true;
+            } else if (positional == 0) {
+                serverIP = arg;
+                positional++;
+            } else {
+                port = std::stoi(arg);
+            }
         }
 
-        GameClient client(serverIP);
+        GameClient client(serverIP, port, spectate);
         client.start();
 
         return 0;
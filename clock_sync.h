@@ -0,0 +1,112 @@
+#ifndef CLOCK_SYNC_H
+#define CLOCK_SYNC_H
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include "common.h"
+#include "rtt_stats.h"
+
+// Wall-clock microseconds, the timestamp unit of PING/PONG
+inline int64_t wallClockMicros() {
+    return std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count();
+}
+
+// Client-side estimate of the server clock, NTP style. The client sends
+// PING t0 and the server answers PONG t0 t1 t2 with its receive and send
+// times; t3 is when the answer arrives. Each exchange gives
+//   rtt    = (t3 - t0) - (t2 - t1)
+//   offset = ((t1 - t0) + (t2 - t3)) / 2
+// and, as in NTP's clock filter, the offset of the lowest-RTT sample among
+// the last CLOCK_SYNC_WINDOW is used since it suffered the least queueing.
+class ClockSync {
+private:
+    struct Sample {
+        double rttMs;
+        double offsetMs;
+    };
+
+    std::array<Sample, CLOCK_SYNC_WINDOW> window;
+    size_t sampleCount;
+    size_t nextSample;
+    double offsetMs;
+    double lastRttMs;
+    RttStats rtt;
+    std::chrono::steady_clock::time_point nextPing;
+
+public:
+    ClockSync()
+        : window(), sampleCount(0), nextSample(0), offsetMs(0), lastRttMs(0), rtt(),
+          nextPing(std::chrono::steady_clock::now()) {}
+
+    // Returns true and fills message when the next PING is due
+    bool pollPing(std::chrono::steady_clock::time_point now, std::string& message) {
+        if (now < nextPing) {
+            return false;
+        }
+        nextPing = now + std::chrono::milliseconds(CLOCK_SYNC_INTERVAL_MS);
+        message = "PING " + std::to_string(wallClockMicros());
+        return true;
+    }
+
+    // Milliseconds until the next PING is due, for poll timeouts
+    int msUntilPing(std::chrono::steady_clock::time_point now) const {
+        if (now >= nextPing) {
+            return 0;
+        }
+        return static_cast<int>(std::chrono::duration_cast<std::chrono::milliseconds>(nextPing - now).count()) + 1;
+    }
+
+    // Fold in one PONG; returns false if the timestamps make no sense
+    bool onPong(int64_t t0, int64_t t1, int64_t t2) {
+        int64_t t3 = wallClockMicros();
+        double sampleRttMs = ((t3 - t0) - (t2 - t1)) / 1000.0;
+        if (t3 < t0 || t2 < t1 || sampleRttMs < 0) {
+            return false;
+        }
+
+        Sample& sample = window[nextSample];
+        sample.rttMs = sampleRttMs;
+        sample.offsetMs = ((t1 - t0) + (t2 - t3)) / 2000.0;
+        nextSample = (nextSample + 1) % window.size();
+        sampleCount = std::min(sampleCount + 1, window.size());
+
+        const Sample* best = &window[0];
+        for (size_t i = 1; i < sampleCount; i++) {
+            if (window[i].rttMs < best->rttMs) {
+                best = &window[i];
+            }
+        }
+        offsetMs = best->offsetMs;
+        lastRttMs = sampleRttMs;
+        rtt.add(sampleRttMs);
+        return true;
+    }
+
+    bool isSynced() const {
+        return sampleCount > 0;
+    }
+
+    // Server clock minus client clock
+    double getOffsetMs() const {
+        return offsetMs;
+    }
+
+    double getLastRttMs() const {
+        return lastRttMs;
+    }
+
+    const RttStats& getRttStats() const {
+        return rtt;
+    }
+
+    // Current server wall-clock time as estimated from this side, in microseconds
+    int64_t serverNowMicros() const {
+        return wallClockMicros() + static_cast<int64_t>(offsetMs * 1000);
+    }
+};
+
+#endif // CLOCK_SYNC_H
@@ -2,23 +2,116 @@
 #define COMMON_H
 
 #include <string>
+#include <string_view>
 #include <cstdint>
+#include <cstddef>
 #include <vector>
 #include <chrono>
 
 // Game constants
 constexpr int DEFAULT_PORT = 8080;
-constexpr int MAX_BUFFER_SIZE = 1024;
+constexpr int MAX_BUFFER_SIZE = 2048;
+constexpr size_t DEFAULT_BUNDLE_MTU = 1200;
+constexpr int STATS_INTERVAL_SECONDS = 5;
 constexpr int GAME_DURATION_SECONDS = 60;
 constexpr int INACTIVITY_TIMEOUT_SECONDS = 10;
 
+// Per-client input rate limiting
+constexpr double INPUT_TOKENS_PER_SECOND = 30.0;
+constexpr double INPUT_BURST_TOKENS = 10.0;
+
+// Separate allowance for PROBEACK and PING, so input limiting never looks like path loss
+constexpr double CONTROL_TOKENS_PER_SECOND = 10.0;
+constexpr double CONTROL_BURST_TOKENS = 10.0;
+
+// JOIN and SPECTATE from addresses without a session, per hashed address slot
+// (slot count must be a power of two)
+constexpr double HANDSHAKE_TOKENS_PER_SECOND = 5.0;
+constexpr double HANDSHAKE_BURST_TOKENS = 5.0;
+constexpr size_t HANDSHAKE_BUCKET_SLOTS = 4096;
+
+// io_uring backend sizing (buffer count must be a power of two)
+constexpr unsigned IO_URING_ENTRIES = 256;
+constexpr unsigned IO_URING_CQ_ENTRIES = 4096;
+constexpr unsigned IO_URING_RECV_BUFFERS = 512;
+
+// Datagrams drained per recvmmsg in busy-poll mode
+constexpr int BUSY_POLL_BATCH = 32;
+
+// Gateway/shard shared-memory rings. Shards inherit their doorbell
+// eventfds from the gateway at these descriptor numbers.
+constexpr uint64_t SHM_RING_SLOTS = 1024;
+constexpr int SHARD_INBOUND_DOORBELL_FD = 3;
+constexpr int SHARD_OUTBOUND_DOORBELL_FD = 4;
+
+// Initial size of each thread's per-tick arena; it grows if a tick needs more
+constexpr size_t TICK_ARENA_BYTES = 64 * 1024;
+
+// Spectator relay: snapshots per second by default, and how often a
+// spectating client repeats SPECTATE to stay subscribed
+constexpr double DEFAULT_SPECTATOR_RATE = 5.0;
+constexpr int SPECTATOR_KEEPALIVE_SECONDS = 3;
+
+// Match result persistence: the writer waits this long to batch records,
+// keeps this many matches in detail and compacts once this many more pile up
+constexpr const char* DEFAULT_RESULTS_PATH = "maze_results.log";
+constexpr int PERSIST_BATCH_MS = 100;
+constexpr size_t PERSIST_HISTORY_MATCHES = 64;
+constexpr size_t PERSIST_COMPACT_MATCHES = 256;
+constexpr size_t LEADERBOARD_ENTRIES = 10;
+
+// Per-client send pacing: probe cadence, AIMD step and upper bounds
+constexpr int PROBE_INTERVAL_MS = 250;
+constexpr int PROBE_TIMEOUT_MIN_MS = 1000;
+constexpr size_t PROBE_WINDOW = 8;
+constexpr int SEND_INTERVAL_STEP_MS = 5;
+constexpr int MAX_SEND_INTERVAL_MS = 500;
+constexpr size_t MAX_SEND_BUDGET_BYTES = 32 * 1024;
+constexpr size_t MAX_PENDING_MESSAGES = 1024;
+
+// Clock sync: how often a client sends PING and how many recent exchanges
+// it picks the lowest-RTT sample from
+constexpr int CLOCK_SYNC_INTERVAL_MS = 1000;
+constexpr size_t CLOCK_SYNC_WINDOW = 8;
+
+// Span tracing: spans kept per thread, and where dumps go by default
+constexpr uint64_t TRACE_RING_EVENTS = 64 * 1024;
+constexpr const char* DEFAULT_TRACE_PATH = "maze_trace.json";
+
+// Reader slots for published world snapshots (spectator relay, future consumers)
+constexpr size_t RCU_MAX_READERS = 8;
+
+// Redundant input sequencing: unacknowledged inputs repeated per MOVE, and
+// the bounds on how long a client waits for the POS ack before sending them
+// again (the wait itself follows the measured MOVE->ack time)
+constexpr size_t MAX_REDUNDANT_INPUTS = 8;
+constexpr int INPUT_RESEND_INITIAL_MS = 200;
+constexpr int INPUT_RESEND_MIN_MS = 100;
+constexpr int INPUT_RESEND_MAX_MS = 2000;
+
+// Join handshake cookie lifetime, and how often a client repeats its JOIN
+// until WELCOME arrives
+constexpr int COOKIE_WINDOW_SECONDS = 10;
+constexpr int JOIN_RETRY_MS = 1000;
+
 // Maze dimensions
 constexpr int MAZE_WIDTH = 10;
 constexpr int MAZE_HEIGHT = 10;
 
+// Scoreboard entries per SCORES message
+constexpr int MAX_SCORE_ENTRIES = 32;
+
+// Player positions per PLAYERS message, which keeps it within one bundle
+constexpr int MAX_VIEW_ENTRIES = 48;
+
+// Client rendering
+constexpr int RENDER_FPS = 30;
+constexpr int MAX_RECEIVE_BURST = 64;
+
 // Message types
 enum class MessageType {
     JOIN,
+    CHALLENGE,
     WELCOME,
     MOVE,
     POS,
@@ -26,7 +119,17 @@ enum class MessageType {
     COLLECTED,
     SCORES,
     KICK,
-    GAMEOVER
+    GAMEOVER,
+    SPECTATE,
+    SPECTATING,
+    SNAPSHOT,
+    LEADERS,
+    PROBE,
+    PROBEACK,
+    PING,
+    PONG,
+    REJOIN,
+    PLAYERS
 };
 
 // Direction enum
@@ -38,7 +141,7 @@ enum class Direction {
 };
 
 // Convert string to Direction
-inline Direction stringToDirection(const std::string& dir) {
+inline Direction stringToDirection(std::string_view dir) {
     if (dir == "UP" || dir == "W" || dir == "w") return Direction::UP;
     if (dir == "DOWN" || dir == "S" || dir == "s") return Direction::DOWN;
     if (dir == "LEFT" || dir == "A" || dir == "a") return Direction::LEFT;
@@ -53,14 +156,15 @@ struct Player {
     int x;
     int y;
     int score;
+    uint32_t lastInputSeq;  // Newest client input applied, echoed in POS
     std::chrono::steady_clock::time_point lastActivity;
 
     // Default constructor (required for std::map)
-    Player() : id(-1), username(""), x(0), y(0), score(0),
+    Player() : id(-1), username(""), x(0), y(0), score(0), lastInputSeq(0),
                lastActivity(std::chrono::steady_clock::now()) {}
 
     Player(int _id, const std::string& _username, int _x, int _y)
-        : id(_id), username(_username), x(_x), y(_y), score(0),
+        : id(_id), username(_username), x(_x), y(_y), score(0), lastInputSeq(0),
           lastActivity(std::chrono::steady_clock::now()) {}
 };
 
@@ -76,4 +180,26 @@ struct Position {
     }
 };
 
+// One player's state in a published world snapshot
+struct SnapshotEntry {
+    int id;
+    int x;
+    int y;
+    int score;
+    std::string name;
+    std::chrono::steady_clock::time_point lastActivity;
+};
+
+// Copy of the world taken at the end of a tick and published through an
+// RcuCell. Once published it is never modified, so readers on any thread
+// can use it without taking playersMutex.
+struct WorldSnapshot {
+    uint64_t tick;
+    std::chrono::steady_clock::time_point takenAt;
+    Position treasure;
+    std::vector<SnapshotEntry> players;
+
+    WorldSnapshot() : tick(0), takenAt(), treasure(), players() {}
+};
+
 #endif // COMMON_H
@@ -0,0 +1,111 @@
+#ifndef COOKIE_H
+#define COOKIE_H
+
+#include <cstdint>
+#include <cstring>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <random>
+#include <chrono>
+#include <netinet/in.h>
+#include "common.h"
+
+// SipHash-2-4 keyed hash, used as the MAC for join cookies
+inline uint64_t sipHash24(const uint64_t key[2], const uint8_t* data, size_t len) {
+    auto rotl = [](uint64_t x, int b) { return (x << b) | (x >> (64 - b)); };
+
+    uint64_t v0 = 0x736f6d6570736575ULL ^ key[0];
+    uint64_t v1 = 0x646f72616e646f6dULL ^ key[1];
+    uint64_t v2 = 0x6c7967656e657261ULL ^ key[0];
+    uint64_t v3 = 0x7465646279746573ULL ^ key[1];
+
+    auto round = [&]() {
+        v0 += v1; v1 = rotl(v1, 13); v1 ^= v0; v0 = rotl(v0, 32);
+        v2 += v3; v3 = rotl(v3, 16); v3 ^= v2;
+        v0 += v3; v3 = rotl(v3, 21); v3 ^= v0;
+        v2 += v1; v1 = rotl(v1, 17); v1 ^= v2; v2 = rotl(v2, 32);
+    };
+
+    size_t blocks = len / 8;
+    for (size_t i = 0; i < blocks; i++) {
+        uint64_t m;
+        memcpy(&m, data + i * 8, 8);
+        v3 ^= m;
+        round();
+        round();
+        v0 ^= m;
+    }
+
+    uint64_t last = static_cast<uint64_t>(len) << 56;
+    for (size_t i = 0; i < len % 8; i++) {
+        last |= static_cast<uint64_t>(data[blocks * 8 + i]) << (8 * i);
+    }
+    v3 ^= last;
+    round();
+    round();
+    v0 ^= last;
+
+    v2 ^= 0xff;
+    round();
+    round();
+    round();
+    round();
+
+    return v0 ^ v1 ^ v2 ^ v3;
+}
+
+// Issues and checks stateless join cookies bound to a source address.
+// A cookie stays valid for the window it was issued in and the one after.
+class CookieIssuer {
+private:
+    uint64_t secret[2];
+
+    static uint64_t currentWindow() {
+        auto now = std::chrono::steady_clock::now().time_since_epoch();
+        return std::chrono::duration_cast<std::chrono::seconds>(now).count() / COOKIE_WINDOW_SECONDS;
+    }
+
+    uint64_t compute(const struct sockaddr_in& addr, uint64_t window) const {
+        uint8_t data[16];
+        memcpy(data, &addr.sin_addr.s_addr, 4);
+        memcpy(data + 4, &addr.sin_port, 2);
+        memset(data + 6, 0, 2);
+        memcpy(data + 8, &window, 8);
+        return sipHash24(secret, data, sizeof(data));
+    }
+
+public:
+    CookieIssuer() {
+        std::random_device rd;
+        for (uint64_t& word : secret) {
+            word = (static_cast<uint64_t>(rd()) << 32) | rd();
+        }
+    }
+
+    // Cookie for this address in the current window, as 16 hex digits
+    std::string issue(const struct sockaddr_in& addr) const {
+        char hex[17];
+        snprintf(hex, sizeof(hex), "%016llx",
+                 static_cast<unsigned long long>(compute(addr, currentWindow())));
+        return std::string(hex);
+    }
+
+    // Check an echoed cookie against the current and previous window
+    bool verify(const struct sockaddr_in& addr, const std::string& cookie) const {
+        if (cookie.size() != 16) {
+            return false;
+        }
+
+        char* end = nullptr;
+        uint64_t value = strtoull(cookie.c_str(), &end, 16);
+        if (end != cookie.c_str() + cookie.size()) {
+            return false;
+        }
+
+        uint64_t window = currentWindow();
+        return value == compute(addr, window) || value == compute(addr, window - 1);
+    }
+};
+
+#endif // COOKIE_H
@@ -0,0 +1,98 @@
+#ifndef FLOW_FIELD_H
+#define FLOW_FIELD_H
+
+#include <vector>
+#include <climits>
+#include <algorithm>
+#include "common.h"
+
+// Distance field over the maze, built by one multi-source BFS from every
+// target. Each cell also stores the step that leads one cell closer, so any
+// number of agents can follow the field in O(1) per move.
+class FlowField {
+private:
+    static constexpr int UNREACHABLE = INT_MAX;
+
+    std::vector<int> distance;
+    std::vector<Direction> step;
+    std::vector<bool> hasStep;
+    std::vector<Position> frontier;  // BFS queue, kept between rebuilds to avoid reallocating
+
+    static int index(int x, int y) {
+        return (y - 1) * MAZE_WIDTH + (x - 1);
+    }
+
+    static bool inBounds(int x, int y) {
+        return x >= 1 && x <= MAZE_WIDTH && y >= 1 && y <= MAZE_HEIGHT;
+    }
+
+public:
+    FlowField()
+        : distance(MAZE_WIDTH * MAZE_HEIGHT, UNREACHABLE),
+          step(MAZE_WIDTH * MAZE_HEIGHT, Direction::DOWN),
+          hasStep(MAZE_WIDTH * MAZE_HEIGHT, false), frontier() {
+        frontier.reserve(MAZE_WIDTH * MAZE_HEIGHT);
+    }
+
+    // Rebuild the field toward the given targets
+    void recompute(const std::vector<Position>& targets) {
+        recompute(targets.data(), targets.size());
+    }
+
+    void recompute(const Position* targets, size_t count) {
+        std::fill(distance.begin(), distance.end(), UNREACHABLE);
+        std::fill(hasStep.begin(), hasStep.end(), false);
+
+        // Each cell is queued at most once, so a vector with a read index is enough
+        frontier.clear();
+        for (size_t i = 0; i < count; i++) {
+            const Position& target = targets[i];
+            if (inBounds(target.x, target.y) && distance[index(target.x, target.y)] != 0) {
+                distance[index(target.x, target.y)] = 0;
+                frontier.push_back(target);
+            }
+        }
+
+        // Expanding from a cell to a neighbour means the neighbour steps back toward it
+        struct Neighbour {
+            int dx;
+            int dy;
+            Direction back;
+        };
+        static const Neighbour neighbours[] = {
+            {0, -1, Direction::DOWN},
+            {0, 1, Direction::UP},
+            {-1, 0, Direction::RIGHT},
+            {1, 0, Direction::LEFT}
+        };
+
+        for (size_t head = 0; head < frontier.size(); head++) {
+            Position cell = frontier[head];
+            int nextDistance = distance[index(cell.x, cell.y)] + 1;
+
+            for (const Neighbour& n : neighbours) {
+                int nx = cell.x + n.dx;
+                int ny = cell.y + n.dy;
+                if (!inBounds(nx, ny) || distance[index(nx, ny)] != UNREACHABLE) {
+                    continue;
+                }
+
+                distance[index(nx, ny)] = nextDistance;
+                step[index(nx, ny)] = n.back;
+                hasStep[index(nx, ny)] = true;
+                frontier.push_back(Position(nx, ny));
+            }
+        }
+    }
+
+    // Direction that moves one cell closer to the nearest target, if any
+    bool nextStep(int x, int y, Direction& dir) const {
+        if (!inBounds(x, y) || !hasStep[index(x, y)]) {
+            return false;
+        }
+        dir = step[index(x, y)];
+        return true;
+    }
+};
+
+#endif // FLOW_FIELD_H
@@ -0,0 +1,300 @@
+#include <iostream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include <chrono>
+#include <csignal>
+#include <cstring>
+#include <cerrno>
+#include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+#include <sys/eventfd.h>
+#include <sys/wait.h>
+#include <netinet/in.h>
+#include "common.h"
+#include "udp_helper.h"
+#include "shm_ring.h"
+
+// UDP gateway in front of several server processes. It owns the public
+// socket, routes each client to a shard by its address, and hands datagrams
+// over through shared-memory rings. A shard that crashes or finishes its game
+// is restarted on its own without disturbing the others; its clients are told
+// to REJOIN, since the new process knows none of them.
+
+using Clock = std::chrono::steady_clock;
+
+constexpr int SHARD_RESTART_DELAY_MS = 1000;
+constexpr int GATEWAY_RECEIVE_BURST = 256;
+
+struct Shard {
+    std::string name;
+    ShmRing inbound;   // Gateway -> shard
+    ShmRing outbound;  // Shard -> gateway
+    int inboundDoorbell;
+    pid_t pid;
+    Clock::time_point restartAt;
+    uint64_t routed;
+    uint64_t dropped;
+    std::unordered_map<uint64_t, struct sockaddr_in> routes;  // Clients this shard process has a session with
+
+    Shard() : inboundDoorbell(-1), pid(-1), restartAt(), routed(0), dropped(0), routes() {}
+};
+
+static volatile sig_atomic_t stopRequested = 0;
+
+static void handleStopSignal(int) {
+    stopRequested = 1;
+}
+
+// Fork and exec one server process wired to the shard's rings
+static bool spawnShard(Shard& shard, int outboundDoorbell, const std::string& serverPath,
+                       const std::vector<std::string>& serverArgs) {
+    pid_t pid = fork();
+    if (pid < 0) {
+        std::cerr << "Error forking shard " << shard.name << std::endl;
+        return false;
+    }
+
+    if (pid == 0) {
+        // The shard finds its doorbells at fixed descriptor numbers. Move them
+        // out of the way first in case either already sits on one of those.
+        int inboundCopy = fcntl(shard.inboundDoorbell, F_DUPFD, 16);
+        int outboundCopy = fcntl(outboundDoorbell, F_DUPFD, 16);
+        if (inboundCopy < 0 || outboundCopy < 0 ||
+            dup2(inboundCopy, SHARD_INBOUND_DOORBELL_FD) < 0 ||
+            dup2(outboundCopy, SHARD_OUTBOUND_DOORBELL_FD) < 0) {
+            _exit(EXIT_FAILURE);
+        }
+        close(inboundCopy);
+        close(outboundCopy);
+
+        std::vector<char*> argv;
+        argv.push_back(const_cast<char*>(serverPath.c_str()));
+        for (const std::string& arg : serverArgs) {
+            argv.push_back(const_cast<char*>(arg.c_str()));
+        }
+        std::string shardFlag = "--shard";
+        argv.push_back(const_cast<char*>(shardFlag.c_str()));
+        argv.push_back(const_cast<char*>(shard.name.c_str()));
+        argv.push_back(nullptr);
+
+        execv(serverPath.c_str(), argv.data());
+        std::cerr << "Error starting " << serverPath << std::endl;
+        _exit(EXIT_FAILURE);
+    }
+
+    shard.pid = pid;
+    std::cout << "Started shard " << shard.name << " (pid " << pid << ")" << std::endl;
+    return true;
+}
+
+// Send everything a shard has queued for its clients. Anyone it answers with
+// more than a CHALLENGE has a session there, so only real sessions (not a
+// spoofed JOIN flood) end up in the route table.
+static void forwardReplies(int sockfd, Shard& shard, std::string& message) {
+    struct sockaddr_in clientAddr;
+    while (shard.outbound.pop(clientAddr, message)) {
+        sendto(sockfd, message.data(), message.size(), 0,
+               (struct sockaddr*)&clientAddr, sizeof(clientAddr));
+        if (message.compare(0, 10, "CHALLENGE ") != 0) {
+            shard.routes.emplace(addressKey(clientAddr), clientAddr);
+        }
+    }
+}
+
+// A shard exited: deliver its last replies, throw away input it will never
+// read, and send its clients back through JOIN on the next process
+static void retireShard(int sockfd, Shard& shard, std::string& message) {
+    forwardReplies(sockfd, shard, message);
+    size_t stale = shard.inbound.discard();
+
+    const char rejoinMsg[] = "REJOIN";
+    for (const auto& route : shard.routes) {
+        sendto(sockfd, rejoinMsg, sizeof(rejoinMsg) - 1, 0,
+               (struct sockaddr*)&route.second, sizeof(route.second));
+    }
+    std::cout << "Shard " << shard.name << " exited, restarting: " << shard.routes.size()
+              << " clients told to rejoin, " << stale << " unread datagrams dropped" << std::endl;
+    shard.routes.clear();
+}
+
+int main(int argc, char* argv[]) {
+    int port = DEFAULT_PORT;
+    int shardCount = 2;
+    std::string serverPath = "./server";
+    std::vector<std::string> serverArgs;
+
+    // Optional port and flags; anything after "--" is passed to every shard
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+
+        if (arg == "--") {
+            for (i++; i < argc; i++) {
+                serverArgs.push_back(argv[i]);
+            }
+        } else if (arg == "--shards" && i + 1 < argc) {
+            shardCount = std::stoi(argv[++i]);
+        } else if (arg == "--server" && i + 1 < argc) {
+            serverPath = argv[++i];
+        } else {
+            port = std::stoi(arg);
+        }
+    }
+
+    if (shardCount < 1) {
+        std::cerr << "Need at least one shard" << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    int sockfd = socket(AF_INET, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (sockfd < 0) {
+        std::cerr << "Error creating socket" << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    struct sockaddr_in gatewayAddr;
+    memset(&gatewayAddr, 0, sizeof(gatewayAddr));
+    gatewayAddr.sin_family = AF_INET;
+    gatewayAddr.sin_addr.s_addr = htonl(INADDR_ANY);
+    gatewayAddr.sin_port = htons(port);
+
+    if (bind(sockfd, (struct sockaddr*)&gatewayAddr, sizeof(gatewayAddr)) < 0) {
+        std::cerr << "Error binding socket" << std::endl;
+        close(sockfd);
+        return EXIT_FAILURE;
+    }
+
+    // One doorbell shared by all outbound rings, one per inbound ring
+    int outboundDoorbell = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (outboundDoorbell < 0) {
+        std::cerr << "Error creating eventfd" << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    std::vector<Shard> shards(shardCount);
+    for (int i = 0; i < shardCount; i++) {
+        Shard& shard = shards[i];
+        shard.name = "shard" + std::to_string(i) + "-" + std::to_string(getpid());
+        shard.inboundDoorbell = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        if (shard.inboundDoorbell < 0 ||
+            !shard.inbound.create(ShardLink::shardRingName(shard.name, true), shard.inboundDoorbell) ||
+            !shard.outbound.create(ShardLink::shardRingName(shard.name, false), outboundDoorbell)) {
+            std::cerr << "Error setting up rings for " << shard.name << std::endl;
+            return EXIT_FAILURE;
+        }
+    }
+
+    signal(SIGINT, handleStopSignal);
+    signal(SIGTERM, handleStopSignal);
+
+    for (Shard& shard : shards) {
+        spawnShard(shard, outboundDoorbell, serverPath, serverArgs);
+    }
+
+    std::cout << "Gateway listening on port " << port << " with " << shardCount << " shards" << std::endl;
+
+    char buffer[MAX_BUFFER_SIZE];
+    std::string message;
+    auto lastStats = Clock::now();
+
+    while (!stopRequested) {
+        // Sleep only when every outbound ring is empty after announcing the wait
+        bool outboundPending = false;
+        for (Shard& shard : shards) {
+            shard.outbound.prepareWait();
+            if (!shard.outbound.empty()) {
+                outboundPending = true;
+            }
+        }
+
+        struct pollfd fds[2];
+        fds[0].fd = sockfd;
+        fds[0].events = POLLIN;
+        fds[1].fd = outboundDoorbell;
+        fds[1].events = POLLIN;
+
+        int ready = poll(fds, 2, outboundPending ? 0 : 100);
+        if (ready < 0 && errno != EINTR) {
+            std::cerr << "Poll error" << std::endl;
+            break;
+        }
+
+        for (Shard& shard : shards) {
+            shard.outbound.finishWait();
+        }
+        if (ready > 0 && (fds[1].revents & POLLIN)) {
+            clearDoorbell(outboundDoorbell);
+        }
+
+        // Route client datagrams; a client always lands on the same shard
+        if (ready > 0 && (fds[0].revents & POLLIN)) {
+            for (int n = 0; n < GATEWAY_RECEIVE_BURST; n++) {
+                struct sockaddr_in clientAddr;
+                socklen_t addrLen = sizeof(clientAddr);
+                ssize_t bytes = recvfrom(sockfd, buffer, sizeof(buffer), 0,
+                                         (struct sockaddr*)&clientAddr, &addrLen);
+                if (bytes <= 0) {
+                    break;
+                }
+
+                // While a shard is down its datagrams are dropped rather than
+                // left to go stale in the ring; clients retry their JOIN
+                Shard& shard = shards[addressKey(clientAddr) % shards.size()];
+                if (shard.pid != -1 && shard.inbound.push(clientAddr, buffer, bytes)) {
+                    shard.routed++;
+                } else {
+                    shard.dropped++;
+                }
+            }
+        }
+
+        // Forward shard replies to their clients
+        for (Shard& shard : shards) {
+            forwardReplies(sockfd, shard, message);
+        }
+
+        // Restart shards that exited, after a short delay
+        auto now = Clock::now();
+        int status;
+        pid_t exited;
+        while ((exited = waitpid(-1, &status, WNOHANG)) > 0) {
+            for (Shard& shard : shards) {
+                if (shard.pid == exited) {
+                    retireShard(sockfd, shard, message);
+                    shard.pid = -1;
+                    shard.restartAt = now + std::chrono::milliseconds(SHARD_RESTART_DELAY_MS);
+                }
+            }
+        }
+        for (Shard& shard : shards) {
+            if (shard.pid == -1 && now >= shard.restartAt) {
+                spawnShard(shard, outboundDoorbell, serverPath, serverArgs);
+            }
+        }
+
+        std::chrono::duration<double> sinceStats = now - lastStats;
+        if (sinceStats.count() >= STATS_INTERVAL_SECONDS) {
+            for (Shard& shard : shards) {
+                std::cout << "Gateway " << shard.name << ": routed " << shard.routed
+                          << ", dropped " << shard.dropped << std::endl;
+            }
+            lastStats = now;
+        }
+    }
+
+    std::cout << "Gateway shutting down" << std::endl;
+    for (Shard& shard : shards) {
+        if (shard.pid > 0) {
+            kill(shard.pid, SIGTERM);
+            waitpid(shard.pid, nullptr, 0);
+        }
+        shm_unlink(ShardLink::shardRingName(shard.name, true).c_str());
+        shm_unlink(ShardLink::shardRingName(shard.name, false).c_str());
+    }
+    close(sockfd);
+
+    return 0;
+}
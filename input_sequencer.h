@@ -0,0 +1,145 @@
+#ifndef INPUT_SEQUENCER_H
+#define INPUT_SEQUENCER_H
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <string>
+#include "common.h"
+
+// Client side of redundant input sequencing. Every input gets the next
+// sequence number and every MOVE datagram repeats all inputs the server has
+// not acknowledged yet, up to MAX_REDUNDANT_INPUTS:
+//   MOVE id seq count dir*    (dirs oldest first, the last one is seq)
+// The server applies each sequence number once and in order, and echoes the
+// newest one it applied in POS, so a lost MOVE is repaired by the next one
+// instead of costing a round trip.
+//
+// When no new input comes along, pending ones are resent after a timeout
+// taken from the measured MOVE->ack time the way TCP does it (smoothed time
+// plus four deviations, doubling per unanswered resend). That time includes
+// however long the server's pacer holds our POS, so a slowed client does not
+// spend its input allowance on resends the ack is already on its way for.
+class InputSequencer {
+private:
+    std::array<char, MAX_REDUNDANT_INPUTS> directions;  // Indexed by seq % MAX_REDUNDANT_INPUTS
+    uint32_t nextSeq;
+    uint32_t ackedSeq;
+    uint32_t sentSeq;    // Newest seq that has gone out at least once
+    uint32_t timedSeq;   // Seq being timed for an ack sample, 0 for none
+    std::chrono::steady_clock::time_point timedAt;
+    std::chrono::steady_clock::time_point lastSent;
+    double srttMs;       // Below zero until the first sample
+    double rttVarMs;
+    int backoff;         // Doublings since the last ack sample
+
+    // Samples only come from inputs never resent, so an ack is never
+    // matched against the wrong send (Karn's rule)
+    void addSample(double ms) {
+        if (srttMs < 0) {
+            srttMs = ms;
+            rttVarMs = ms / 2;
+        } else {
+            rttVarMs = 0.75 * rttVarMs + 0.25 * std::abs(srttMs - ms);
+            srttMs = 0.875 * srttMs + 0.125 * ms;
+        }
+    }
+
+public:
+    InputSequencer()
+        : directions(), nextSeq(1), ackedSeq(0), sentSeq(0), timedSeq(0), timedAt(), lastSent(),
+          srttMs(-1), rttVarMs(0), backoff(0) {}
+
+    // Record a new input (W/A/S/D) and return its sequence number
+    uint32_t push(char direction) {
+        uint32_t seq = nextSeq++;
+        directions[seq % MAX_REDUNDANT_INPUTS] = direction;
+        return seq;
+    }
+
+    // Forget everything up to the sequence number the server echoed
+    void onAck(uint32_t seq, std::chrono::steady_clock::time_point now) {
+        if (seq <= ackedSeq || seq >= nextSeq) {
+            return;
+        }
+        ackedSeq = seq;
+
+        // Like TCP, keep the backed-off timeout until an unambiguous sample
+        // replaces it, or a slow path would be resent into every time
+        if (timedSeq != 0 && seq >= timedSeq) {
+            addSample(std::chrono::duration<double, std::milli>(now - timedAt).count());
+            timedSeq = 0;
+            backoff = 0;
+        }
+    }
+
+    // Inputs still worth sending; older unacknowledged ones fell out of the window
+    size_t unackedCount() const {
+        return std::min<size_t>(nextSeq - 1 - ackedSeq, MAX_REDUNDANT_INPUTS);
+    }
+
+    uint32_t getNewestSeq() const {
+        return nextSeq - 1;
+    }
+
+    uint32_t getAckedSeq() const {
+        return ackedSeq;
+    }
+
+    // Current wait before pending inputs are resent
+    int getResendTimeoutMs() const {
+        double base = srttMs < 0 ? INPUT_RESEND_INITIAL_MS
+                                 : std::max<double>(srttMs + 4 * rttVarMs, INPUT_RESEND_MIN_MS);
+        return static_cast<int>(std::min<double>(base * (1 << std::min(backoff, 6)), INPUT_RESEND_MAX_MS));
+    }
+
+    // MOVE carrying every unacknowledged input, oldest first
+    std::string buildMove(int playerId, std::chrono::steady_clock::time_point now) {
+        size_t count = unackedCount();
+        uint32_t newest = nextSeq - 1;
+
+        if (newest > sentSeq) {
+            // Carries a new input; time it unless a sample is already running
+            sentSeq = newest;
+            if (timedSeq == 0) {
+                timedSeq = newest;
+                timedAt = now;
+            }
+        } else {
+            // A resend: whatever is being timed may now be acked by either copy
+            timedSeq = 0;
+            backoff++;
+        }
+
+        std::string message = "MOVE " + std::to_string(playerId) + " " + std::to_string(newest) + " " +
+                              std::to_string(count);
+        for (uint32_t seq = newest - count + 1; seq <= newest && count > 0; seq++) {
+            message += ' ';
+            message += directions[seq % MAX_REDUNDANT_INPUTS];
+        }
+
+        lastSent = now;
+        return message;
+    }
+
+    // Unacknowledged inputs went out long enough ago that the MOVE may be lost
+    bool resendDue(std::chrono::steady_clock::time_point now) const {
+        return unackedCount() > 0 && now - lastSent >= std::chrono::milliseconds(getResendTimeoutMs());
+    }
+
+    // Milliseconds until resendDue could turn true, or -1 with nothing to resend
+    int msUntilResend(std::chrono::steady_clock::time_point now) const {
+        if (unackedCount() == 0) {
+            return -1;
+        }
+        auto due = lastSent + std::chrono::milliseconds(getResendTimeoutMs());
+        if (now >= due) {
+            return 0;
+        }
+        return static_cast<int>(std::chrono::duration_cast<std::chrono::milliseconds>(due - now).count()) + 1;
+    }
+};
+
+#endif // INPUT_SEQUENCER_H
@@ -0,0 +1,498 @@
+#ifndef IO_URING_BACKEND_H
+#define IO_URING_BACKEND_H
+
+#include <linux/io_uring.h>
+#include <sys/syscall.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstring>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <mutex>
+#include <algorithm>
+#include <iostream>
+#include "common.h"
+
+// io_uring socket backend for UDPServer, driven through raw syscalls.
+// Receives use one multishot RECVMSG that lands datagrams in a registered
+// ring of provided buffers; sends are prepared as SENDMSG entries and
+// submitted together with a single io_uring_enter.
+class IoUringBackend {
+private:
+    static constexpr uint64_t RECV_USER_DATA = UINT64_MAX;
+    static constexpr uint64_t PROVIDE_USER_DATA = UINT64_MAX - 1;
+    static constexpr uint64_t PROBE_USER_DATA = UINT64_MAX - 2;
+
+    // A send in flight; the kernel reads from it until its completion arrives
+    struct SendSlot {
+        struct msghdr hdr;
+        struct iovec iov;
+        struct sockaddr_in addr;
+        char data[MAX_BUFFER_SIZE];
+    };
+
+    int ringFd;
+    int sockfd;
+
+    // Submission queue
+    void* sqRing;
+    size_t sqRingSize;
+    unsigned* sqHead;
+    unsigned* sqTail;
+    unsigned* sqArray;
+    unsigned sqMask;
+    unsigned sqEntries;
+    unsigned sqLocalTail;
+    struct io_uring_sqe* sqes;
+    size_t sqesSize;
+
+    // Completion queue, only touched by the receiving thread
+    void* cqRing;
+    size_t cqRingSize;
+    unsigned* cqHead;
+    unsigned* cqTail;
+    unsigned cqMask;
+    struct io_uring_cqe* cqes;
+
+    // Provided receive buffers; bufRing is null when falling back to
+    // IORING_OP_PROVIDE_BUFFERS on kernels where the ring does not work
+    struct io_uring_buf_ring* bufRing;
+    size_t bufRingSize;
+    std::vector<char> bufferPool;
+    unsigned bufferSize;
+    unsigned short bufTail;
+    struct msghdr recvHdr;
+
+    std::vector<SendSlot> sendSlots;
+    std::vector<unsigned> freeSendSlots;
+    std::mutex ringMutex;  // Guards the submission queue and send slots
+
+    static int enter(int fd, unsigned toSubmit, unsigned minComplete, unsigned flags,
+                     const void* arg = nullptr, size_t argSize = 0) {
+        return static_cast<int>(syscall(__NR_io_uring_enter, fd, toSubmit, minComplete, flags, arg, argSize));
+    }
+
+    // Next free submission entry, or nullptr when the queue is full; caller holds ringMutex
+    struct io_uring_sqe* getSqe() {
+        unsigned head = __atomic_load_n(sqHead, __ATOMIC_ACQUIRE);
+        if (sqLocalTail - head >= sqEntries) {
+            return nullptr;
+        }
+
+        unsigned index = sqLocalTail & sqMask;
+        sqArray[index] = index;
+        sqLocalTail++;
+
+        struct io_uring_sqe* sqe = &sqes[index];
+        memset(sqe, 0, sizeof(*sqe));
+        return sqe;
+    }
+
+    // Hand every prepared entry to the kernel; caller holds ringMutex
+    void submitLocked() {
+        unsigned toSubmit = sqLocalTail - *sqTail;
+        if (toSubmit == 0) {
+            return;
+        }
+
+        __atomic_store_n(sqTail, sqLocalTail, __ATOMIC_RELEASE);
+        if (enter(ringFd, toSubmit, 0, 0) < 0) {
+            std::cerr << "io_uring submit error: " << strerror(errno) << std::endl;
+        }
+    }
+
+    // (Re)arm the multishot receive; caller holds ringMutex
+    bool armReceive() {
+        struct io_uring_sqe* sqe = getSqe();
+        if (!sqe) {
+            return false;
+        }
+
+        sqe->opcode = IORING_OP_RECVMSG;
+        sqe->fd = sockfd;
+        sqe->addr = reinterpret_cast<uint64_t>(&recvHdr);
+        sqe->len = 1;
+        sqe->ioprio = IORING_RECV_MULTISHOT;
+        sqe->flags = IOSQE_BUFFER_SELECT;
+        sqe->buf_group = 0;
+        sqe->user_data = RECV_USER_DATA;
+        return true;
+    }
+
+    // Queue a PROVIDE_BUFFERS entry for count buffers starting at firstId; caller holds ringMutex
+    void provideBuffers(unsigned short firstId, unsigned count) {
+        struct io_uring_sqe* sqe = getSqe();
+        if (!sqe) {
+            submitLocked();
+            sqe = getSqe();
+        }
+
+        sqe->opcode = IORING_OP_PROVIDE_BUFFERS;
+        sqe->fd = static_cast<int>(count);
+        sqe->addr = reinterpret_cast<uint64_t>(bufferPool.data() + firstId * bufferSize);
+        sqe->len = bufferSize;
+        sqe->off = firstId;
+        sqe->buf_group = 0;
+        sqe->flags = IOSQE_CQE_SKIP_SUCCESS;
+        sqe->user_data = PROVIDE_USER_DATA;
+    }
+
+    // Give a receive buffer back to the kernel
+    void recycleBuffer(unsigned short bufferId) {
+        if (!bufRing) {
+            // Goes out with the next submit
+            std::lock_guard<std::mutex> lock(ringMutex);
+            provideBuffers(bufferId, 1);
+            return;
+        }
+
+        struct io_uring_buf* buf = &bufRing->bufs[bufTail & (IO_URING_RECV_BUFFERS - 1)];
+        buf->addr = reinterpret_cast<uint64_t>(bufferPool.data() + bufferId * bufferSize);
+        buf->len = bufferSize;
+        buf->bid = bufferId;
+        bufTail++;
+        __atomic_store_n(&bufRing->tail, bufTail, __ATOMIC_RELEASE);
+    }
+
+    // Register the provided buffer ring (group 0) and fill it. Some kernels
+    // accept the registration but never hand out ring buffers, so receive one
+    // byte over a socketpair to make sure it actually works.
+    bool setupBufferRing() {
+        bufRingSize = IO_URING_RECV_BUFFERS * sizeof(struct io_uring_buf);
+        void* bufRingMap = mmap(nullptr, bufRingSize, PROT_READ | PROT_WRITE,
+                                MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (bufRingMap == MAP_FAILED) {
+            return false;
+        }
+        bufRing = static_cast<struct io_uring_buf_ring*>(bufRingMap);
+
+        struct io_uring_buf_reg reg;
+        memset(&reg, 0, sizeof(reg));
+        reg.ring_addr = reinterpret_cast<uint64_t>(bufRing);
+        reg.ring_entries = IO_URING_RECV_BUFFERS;
+        reg.bgid = 0;
+        if (syscall(__NR_io_uring_register, ringFd, IORING_REGISTER_PBUF_RING, &reg, 1) < 0) {
+            munmap(bufRing, bufRingSize);
+            bufRing = nullptr;
+            return false;
+        }
+
+        for (unsigned i = 0; i < IO_URING_RECV_BUFFERS; i++) {
+            recycleBuffer(static_cast<unsigned short>(i));
+        }
+
+        int pair[2];
+        if (socketpair(AF_UNIX, SOCK_DGRAM | SOCK_NONBLOCK, 0, pair) < 0) {
+            return true; // Can't check, trust the registration
+        }
+
+        int result = -1;
+        if (write(pair[1], "x", 1) == 1) {
+            std::lock_guard<std::mutex> lock(ringMutex);
+            struct io_uring_sqe* sqe = getSqe();
+            sqe->opcode = IORING_OP_RECV;
+            sqe->fd = pair[0];
+            sqe->flags = IOSQE_BUFFER_SELECT;
+            sqe->buf_group = 0;
+            sqe->user_data = PROBE_USER_DATA;
+            submitLocked();
+            enter(ringFd, 0, 1, IORING_ENTER_GETEVENTS);
+
+            unsigned head = *cqHead;
+            if (head != __atomic_load_n(cqTail, __ATOMIC_ACQUIRE)) {
+                const struct io_uring_cqe& cqe = cqes[head & cqMask];
+                result = cqe.res;
+                if (cqe.flags & IORING_CQE_F_BUFFER) {
+                    recycleBuffer(static_cast<unsigned short>(cqe.flags >> IORING_CQE_BUFFER_SHIFT));
+                }
+                __atomic_store_n(cqHead, head + 1, __ATOMIC_RELEASE);
+            }
+        }
+        close(pair[0]);
+        close(pair[1]);
+
+        if (result < 0) {
+            syscall(__NR_io_uring_register, ringFd, IORING_UNREGISTER_PBUF_RING, &reg, 1);
+            munmap(bufRing, bufRingSize);
+            bufRing = nullptr;
+            return false;
+        }
+
+        return true;
+    }
+
+    // Block until at least one completion is ready or the timeout passes
+    void waitForCompletion(int timeoutMs) {
+        struct __kernel_timespec ts;
+        ts.tv_sec = timeoutMs / 1000;
+        ts.tv_nsec = static_cast<long long>(timeoutMs % 1000) * 1000000;
+
+        struct io_uring_getevents_arg arg;
+        memset(&arg, 0, sizeof(arg));
+        arg.ts = reinterpret_cast<uint64_t>(&ts);
+
+        enter(ringFd, 0, 1, IORING_ENTER_GETEVENTS | IORING_ENTER_EXT_ARG, &arg, sizeof(arg));
+    }
+
+    void release() {
+        if (ringFd >= 0) {
+            close(ringFd);
+            ringFd = -1;
+        }
+        if (bufRing) {
+            munmap(bufRing, bufRingSize);
+            bufRing = nullptr;
+        }
+        if (sqes) {
+            munmap(sqes, sqesSize);
+            sqes = nullptr;
+        }
+        if (cqRing && cqRing != sqRing) {
+            munmap(cqRing, cqRingSize);
+        }
+        cqRing = nullptr;
+        if (sqRing) {
+            munmap(sqRing, sqRingSize);
+            sqRing = nullptr;
+        }
+    }
+
+public:
+    IoUringBackend()
+        : ringFd(-1), sockfd(-1),
+          sqRing(nullptr), sqRingSize(0), sqHead(nullptr), sqTail(nullptr), sqArray(nullptr),
+          sqMask(0), sqEntries(0), sqLocalTail(0), sqes(nullptr), sqesSize(0),
+          cqRing(nullptr), cqRingSize(0), cqHead(nullptr), cqTail(nullptr), cqMask(0), cqes(nullptr),
+          bufRing(nullptr), bufRingSize(0), bufferSize(0), bufTail(0) {
+        memset(&recvHdr, 0, sizeof(recvHdr));
+    }
+
+    ~IoUringBackend() {
+        release();
+    }
+
+    // Set up the rings for a bound socket. Returns false when the kernel lacks
+    // anything this backend needs, so the caller can stay on plain syscalls.
+    bool init(int _sockfd) {
+        sockfd = _sockfd;
+
+        struct io_uring_params params;
+        memset(&params, 0, sizeof(params));
+        params.flags = IORING_SETUP_CQSIZE;
+        params.cq_entries = IO_URING_CQ_ENTRIES;
+
+        ringFd = static_cast<int>(syscall(__NR_io_uring_setup, IO_URING_ENTRIES, &params));
+        if (ringFd < 0) {
+            return false;
+        }
+
+        if (!(params.features & IORING_FEAT_EXT_ARG) || !(params.features & IORING_FEAT_NODROP)) {
+            release();
+            return false;
+        }
+
+        // Map the rings
+        sqRingSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+        cqRingSize = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+        bool singleMmap = params.features & IORING_FEAT_SINGLE_MMAP;
+        if (singleMmap) {
+            sqRingSize = cqRingSize = std::max(sqRingSize, cqRingSize);
+        }
+
+        sqRing = mmap(nullptr, sqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                      ringFd, IORING_OFF_SQ_RING);
+        if (sqRing == MAP_FAILED) {
+            sqRing = nullptr;
+            release();
+            return false;
+        }
+
+        if (singleMmap) {
+            cqRing = sqRing;
+        } else {
+            cqRing = mmap(nullptr, cqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                          ringFd, IORING_OFF_CQ_RING);
+            if (cqRing == MAP_FAILED) {
+                cqRing = nullptr;
+                release();
+                return false;
+            }
+        }
+
+        sqesSize = params.sq_entries * sizeof(struct io_uring_sqe);
+        void* sqesMap = mmap(nullptr, sqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                             ringFd, IORING_OFF_SQES);
+        if (sqesMap == MAP_FAILED) {
+            release();
+            return false;
+        }
+        sqes = static_cast<struct io_uring_sqe*>(sqesMap);
+
+        char* sq = static_cast<char*>(sqRing);
+        sqHead = reinterpret_cast<unsigned*>(sq + params.sq_off.head);
+        sqTail = reinterpret_cast<unsigned*>(sq + params.sq_off.tail);
+        sqMask = *reinterpret_cast<unsigned*>(sq + params.sq_off.ring_mask);
+        sqArray = reinterpret_cast<unsigned*>(sq + params.sq_off.array);
+        sqEntries = params.sq_entries;
+        sqLocalTail = *sqTail;
+
+        char* cq = static_cast<char*>(cqRing);
+        cqHead = reinterpret_cast<unsigned*>(cq + params.cq_off.head);
+        cqTail = reinterpret_cast<unsigned*>(cq + params.cq_off.tail);
+        cqMask = *reinterpret_cast<unsigned*>(cq + params.cq_off.ring_mask);
+        cqes = reinterpret_cast<struct io_uring_cqe*>(cq + params.cq_off.cqes);
+
+        // Each buffer holds the recvmsg header, the source address and the payload
+        bufferSize = sizeof(struct io_uring_recvmsg_out) + sizeof(struct sockaddr_in) + MAX_BUFFER_SIZE;
+        bufferPool.resize(static_cast<size_t>(bufferSize) * IO_URING_RECV_BUFFERS);
+        recvHdr.msg_namelen = sizeof(struct sockaddr_in);
+
+        if (!setupBufferRing()) {
+            std::lock_guard<std::mutex> lock(ringMutex);
+            provideBuffers(0, IO_URING_RECV_BUFFERS);
+        }
+
+        sendSlots.resize(IO_URING_ENTRIES);
+        for (unsigned i = 0; i < IO_URING_ENTRIES; i++) {
+            freeSendSlots.push_back(IO_URING_ENTRIES - 1 - i);
+        }
+
+        // Arm the receive. Kernels without multishot recvmsg reject it inline.
+        {
+            std::lock_guard<std::mutex> lock(ringMutex);
+            armReceive();
+            submitLocked();
+        }
+
+        unsigned tail = __atomic_load_n(cqTail, __ATOMIC_ACQUIRE);
+        for (unsigned head = *cqHead; head != tail; head++) {
+            const struct io_uring_cqe& cqe = cqes[head & cqMask];
+            if (cqe.user_data == RECV_USER_DATA && cqe.res < 0) {
+                release();
+                return false;
+            }
+        }
+
+        return true;
+    }
+
+    // Whether receives use the registered buffer ring rather than PROVIDE_BUFFERS
+    bool usesBufferRing() const {
+        return bufRing != nullptr;
+    }
+
+    // Receive one datagram, waiting up to timeoutMs if none is ready
+    bool receive(std::string& message, struct sockaddr_in& addr, socklen_t& addrLen, int timeoutMs) {
+        bool waited = timeoutMs <= 0;
+
+        while (true) {
+            unsigned head = *cqHead;
+            unsigned tail = __atomic_load_n(cqTail, __ATOMIC_ACQUIRE);
+
+            if (head == tail) {
+                if (waited) {
+                    return false;
+                }
+
+                // Recycled buffers may still be waiting to be handed back
+                {
+                    std::lock_guard<std::mutex> lock(ringMutex);
+                    submitLocked();
+                }
+                waitForCompletion(timeoutMs);
+                waited = true;
+                continue;
+            }
+
+            struct io_uring_cqe cqe = cqes[head & cqMask];
+            __atomic_store_n(cqHead, head + 1, __ATOMIC_RELEASE);
+
+            if (cqe.user_data == PROVIDE_USER_DATA) {
+                continue;
+            }
+
+            if (cqe.user_data != RECV_USER_DATA) {
+                // A send finished, its slot can be reused
+                std::lock_guard<std::mutex> lock(ringMutex);
+                freeSendSlots.push_back(static_cast<unsigned>(cqe.user_data));
+                continue;
+            }
+
+            // The multishot receive stops on errors or when buffers run out
+            if (!(cqe.flags & IORING_CQE_F_MORE)) {
+                std::lock_guard<std::mutex> lock(ringMutex);
+                armReceive();
+                submitLocked();
+            }
+
+            if (cqe.res < 0 || !(cqe.flags & IORING_CQE_F_BUFFER)) {
+                continue;
+            }
+
+            unsigned short bufferId = static_cast<unsigned short>(cqe.flags >> IORING_CQE_BUFFER_SHIFT);
+            char* buffer = bufferPool.data() + bufferId * bufferSize;
+            const struct io_uring_recvmsg_out* out = reinterpret_cast<const struct io_uring_recvmsg_out*>(buffer);
+            const char* name = buffer + sizeof(struct io_uring_recvmsg_out);
+            const char* payload = name + recvHdr.msg_namelen + recvHdr.msg_controllen;
+
+            size_t payloadLen = std::min<size_t>(out->payloadlen, MAX_BUFFER_SIZE);
+            memcpy(&addr, name, std::min<size_t>(out->namelen, sizeof(addr)));
+            addrLen = sizeof(addr);
+            message.assign(payload, payloadLen);
+
+            recycleBuffer(bufferId);
+            return payloadLen > 0;
+        }
+    }
+
+    // Prepare a send without submitting it. Returns false when the message
+    // cannot be queued, in which case the caller should send it directly.
+    bool queueSend(const struct sockaddr_in& addr, const char* data, size_t len) {
+        if (len > MAX_BUFFER_SIZE) {
+            return false;
+        }
+
+        std::lock_guard<std::mutex> lock(ringMutex);
+        if (freeSendSlots.empty()) {
+            return false;
+        }
+
+        struct io_uring_sqe* sqe = getSqe();
+        if (!sqe) {
+            return false;
+        }
+
+        unsigned slotIndex = freeSendSlots.back();
+        freeSendSlots.pop_back();
+
+        SendSlot& slot = sendSlots[slotIndex];
+        memcpy(slot.data, data, len);
+        slot.addr = addr;
+        slot.iov.iov_base = slot.data;
+        slot.iov.iov_len = len;
+        memset(&slot.hdr, 0, sizeof(slot.hdr));
+        slot.hdr.msg_name = &slot.addr;
+        slot.hdr.msg_namelen = sizeof(slot.addr);
+        slot.hdr.msg_iov = &slot.iov;
+        slot.hdr.msg_iovlen = 1;
+
+        sqe->opcode = IORING_OP_SENDMSG;
+        sqe->fd = sockfd;
+        sqe->addr = reinterpret_cast<uint64_t>(&slot.hdr);
+        sqe->len = 1;
+        sqe->user_data = slotIndex;
+        return true;
+    }
+
+    // Submit every queued send with one syscall
+    void submit() {
+        std::lock_guard<std::mutex> lock(ringMutex);
+        submitLocked();
+    }
+};
+
+#endif // IO_URING_BACKEND_H
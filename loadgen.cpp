@@ -0,0 +1,245 @@
+#include <iostream>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <cerrno>
+#include <cstdio>
+#include <unistd.h>
+#include <poll.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include "common.h"
+#include "input_sequencer.h"
+
+// Loopback load generator. Each simulated client joins through the cookie
+// handshake and then keeps exactly one input in flight, sending the next one
+// as soon as a POS acknowledges it. Reports throughput and MOVE->POS latency.
+
+using Clock = std::chrono::steady_clock;
+
+struct LoadClient {
+    int sockfd;
+    int playerId;
+    bool awaitingReply;
+    bool finished;
+    bool movingRight;
+    Clock::time_point lastSend;
+    InputSequencer inputs;
+    std::string joinMsg;  // Last JOIN sent, repeated until WELCOME
+
+    LoadClient() : sockfd(-1), playerId(-1), awaitingReply(false), finished(false),
+                   movingRight(true), lastSend(), inputs(), joinMsg() {}
+};
+
+struct LoadStats {
+    uint64_t movesSent;
+    uint64_t replies;
+    uint64_t retries;
+    std::vector<double> latenciesUs;
+
+    LoadStats() : movesSent(0), replies(0), retries(0) {}
+};
+
+static struct sockaddr_in serverAddr;
+
+static void sendTo(const LoadClient& client, const std::string& message) {
+    sendto(client.sockfd, message.data(), message.size(), 0,
+           (struct sockaddr*)&serverAddr, sizeof(serverAddr));
+}
+
+// Send the client's next input, alternating direction so it never hits a wall for long
+static void sendMove(LoadClient& client, LoadStats& stats) {
+    client.inputs.push(client.movingRight ? 'D' : 'A');
+    client.movingRight = !client.movingRight;
+
+    client.lastSend = Clock::now();
+    sendTo(client, client.inputs.buildMove(client.playerId, client.lastSend));
+    client.awaitingReply = true;
+    stats.movesSent++;
+}
+
+// Repeat the unacknowledged input without adding a new one
+static void resendMove(LoadClient& client, LoadStats& stats) {
+    sendTo(client, client.inputs.buildMove(client.playerId, Clock::now()));
+    stats.retries++;
+}
+
+// Handle one message from a (possibly bundled) reply
+static void handleLine(LoadClient& client, LoadStats& stats, const std::string& line, int index) {
+    if (line.compare(0, 10, "CHALLENGE ") == 0) {
+        client.joinMsg = "JOIN load" + std::to_string(index) + " " + line.substr(10);
+        client.lastSend = Clock::now();
+        sendTo(client, client.joinMsg);
+    } else if (line.compare(0, 8, "WELCOME ") == 0) {
+        if (client.playerId == -1) {
+            client.playerId = std::stoi(line.substr(8));
+            sendMove(client, stats);
+        }
+    } else if (line.compare(0, 4, "POS ") == 0) {
+        int id, x, y;
+        unsigned ackSeq;
+        if (sscanf(line.c_str(), "POS %d %d %d %u", &id, &x, &y, &ackSeq) != 4 || id != client.playerId) {
+            return;
+        }
+        client.inputs.onAck(ackSeq, Clock::now());
+
+        // Only the POS acknowledging the input in flight completes it
+        if (client.awaitingReply && client.inputs.unackedCount() == 0) {
+            std::chrono::duration<double, std::micro> rtt = Clock::now() - client.lastSend;
+            stats.latenciesUs.push_back(rtt.count());
+            stats.replies++;
+            client.awaitingReply = false;
+        }
+    } else if (line.compare(0, 6, "PROBE ") == 0) {
+        sendTo(client, "PROBEACK " + line.substr(6));
+    } else if (line == "REJOIN") {
+        // The shard serving us restarted; join its successor from scratch
+        if (client.playerId != -1 && !client.finished) {
+            client.playerId = -1;
+            client.awaitingReply = false;
+            client.inputs = InputSequencer();
+            client.joinMsg = "JOIN load" + std::to_string(index);
+            client.lastSend = Clock::now();
+            sendTo(client, client.joinMsg);
+        }
+    } else if (line.compare(0, 4, "KICK") == 0 || line.compare(0, 8, "GAMEOVER") == 0) {
+        client.finished = true;
+    }
+}
+
+static double percentile(const std::vector<double>& sorted, double p) {
+    if (sorted.empty()) {
+        return 0.0;
+    }
+    size_t index = static_cast<size_t>(p * (sorted.size() - 1));
+    return sorted[index];
+}
+
+int main(int argc, char* argv[]) {
+    std::string serverIP = "127.0.0.1";
+    int port = DEFAULT_PORT;
+    int clientCount = 50;
+    int durationSeconds = 10;
+
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+
+        if (arg == "--port" && i + 1 < argc) {
+            port = std::stoi(argv[++i]);
+        } else if (arg == "--clients" && i + 1 < argc) {
+            clientCount = std::stoi(argv[++i]);
+        } else if (arg == "--duration" && i + 1 < argc) {
+            durationSeconds = std::stoi(argv[++i]);
+        } else {
+            serverIP = arg;
+        }
+    }
+
+    memset(&serverAddr, 0, sizeof(serverAddr));
+    serverAddr.sin_family = AF_INET;
+    serverAddr.sin_port = htons(port);
+    if (inet_pton(AF_INET, serverIP.c_str(), &serverAddr.sin_addr) <= 0) {
+        std::cerr << "Invalid address/ Address not supported" << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    std::vector<LoadClient> clients(clientCount);
+    std::vector<struct pollfd> fds(clientCount);
+    LoadStats stats;
+
+    for (int i = 0; i < clientCount; i++) {
+        clients[i].sockfd = socket(AF_INET, SOCK_DGRAM | SOCK_NONBLOCK, 0);
+        if (clients[i].sockfd < 0) {
+            std::cerr << "Error creating socket" << std::endl;
+            return EXIT_FAILURE;
+        }
+        fds[i].fd = clients[i].sockfd;
+        fds[i].events = POLLIN;
+
+        clients[i].joinMsg = "JOIN load" + std::to_string(i);
+        clients[i].lastSend = Clock::now();
+        sendTo(clients[i], clients[i].joinMsg);
+    }
+
+    std::cout << "Running " << clientCount << " clients against " << serverIP << ":" << port
+              << " for " << durationSeconds << "s" << std::endl;
+
+    auto start = Clock::now();
+    auto deadline = start + std::chrono::seconds(durationSeconds);
+    std::vector<char> buffer(65536);
+
+    while (Clock::now() < deadline) {
+        int ready = poll(fds.data(), fds.size(), 10);
+        if (ready < 0 && errno != EINTR) {
+            std::cerr << "Poll error" << std::endl;
+            break;
+        }
+
+        auto now = Clock::now();
+
+        for (int i = 0; i < clientCount; i++) {
+            LoadClient& client = clients[i];
+
+            if (fds[i].revents & POLLIN) {
+                ssize_t bytes;
+                while ((bytes = recv(client.sockfd, buffer.data(), buffer.size(), 0)) > 0) {
+                    size_t begin = 0;
+                    while (begin < static_cast<size_t>(bytes)) {
+                        const char* lineEnd = static_cast<const char*>(
+                            memchr(buffer.data() + begin, '\n', bytes - begin));
+                        size_t end = lineEnd ? lineEnd - buffer.data() : bytes;
+                        handleLine(client, stats, std::string(buffer.data() + begin, end - begin), i);
+                        begin = end + 1;
+                    }
+                }
+            }
+
+            if (client.finished) {
+                continue;
+            }
+            if (client.playerId == -1) {
+                // Repeat the handshake step we are stuck on
+                if (now - client.lastSend >= std::chrono::milliseconds(JOIN_RETRY_MS)) {
+                    client.lastSend = now;
+                    sendTo(client, client.joinMsg);
+                }
+                continue;
+            }
+
+            // Keep one input in flight; repeat it if the ack seems lost
+            if (!client.awaitingReply) {
+                sendMove(client, stats);
+            } else if (client.inputs.resendDue(now)) {
+                resendMove(client, stats);
+            }
+        }
+    }
+
+    std::chrono::duration<double> elapsed = Clock::now() - start;
+    int joined = 0;
+    for (LoadClient& client : clients) {
+        if (client.playerId != -1) {
+            joined++;
+        }
+        close(client.sockfd);
+    }
+
+    std::sort(stats.latenciesUs.begin(), stats.latenciesUs.end());
+
+    std::cout << "Clients joined: " << joined << "/" << clientCount << std::endl;
+    std::cout << "Moves sent: " << stats.movesSent << ", replies: " << stats.replies
+              << ", retries: " << stats.retries << std::endl;
+    std::cout << "Throughput: " << static_cast<uint64_t>(stats.replies / elapsed.count())
+              << " moves/s" << std::endl;
+    std::cout << "MOVE->POS latency (us): p50 " << percentile(stats.latenciesUs, 0.50)
+              << ", p90 " << percentile(stats.latenciesUs, 0.90)
+              << ", p99 " << percentile(stats.latenciesUs, 0.99)
+              << ", p99.9 " << percentile(stats.latenciesUs, 0.999)
+              << ", max " << (stats.latenciesUs.empty() ? 0.0 : stats.latenciesUs.back())
+              << std::endl;
+
+    return 0;
+}
@@ -0,0 +1,483 @@
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <queue>
+#include <algorithm>
+#include <random>
+#include <chrono>
+#include <unordered_map>
+#include <csignal>
+#include <cstring>
+#include <cerrno>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+#include <sys/epoll.h>
+#include <netinet/in.h>
+#include "common.h"
+#include "udp_helper.h"
+
+// UDP proxy that sits between clients and the server and impairs traffic in
+// both directions: fixed delay, uniform jitter, loss, duplication and
+// reordering. Every client gets its own upstream socket so the server still
+// sees one address per client. All random choices come from one seeded
+// generator, and every decision can be logged, so a run can be repeated.
+
+using Clock = std::chrono::steady_clock;
+
+constexpr int PROXY_RECEIVE_BURST = 64;
+constexpr int PROXY_MAX_EVENTS = 256;
+constexpr int PROXY_IDLE_SECONDS = 30;
+
+struct ImpairmentConfig {
+    double delayMs;
+    double jitterMs;
+    double lossPercent;
+    double duplicatePercent;
+    double reorderPercent;
+    double reorderGapMs;  // Extra hold time for a reordered packet
+    uint64_t seed;
+
+    ImpairmentConfig()
+        : delayMs(0), jitterMs(0), lossPercent(0), duplicatePercent(0),
+          reorderPercent(0), reorderGapMs(5), seed(1) {}
+};
+
+// A client seen on the listen socket and its dedicated upstream socket
+struct ProxySession {
+    uint64_t id;  // Never reused, unlike the fd
+    struct sockaddr_in clientAddr;
+    int upstreamFd;
+    Clock::time_point lastActive;
+};
+
+// A datagram waiting for its release time. Payloads live in a pooled slab.
+struct PendingPacket {
+    Clock::time_point release;
+    uint64_t order;    // Tie-breaker so equal release times keep arrival order
+    uint64_t sessionId;  // Upstream session to send from, 0 for the listen socket
+    struct sockaddr_in dest;
+    uint32_t slot;
+    uint32_t len;
+
+    bool operator>(const PendingPacket& other) const {
+        if (release != other.release) {
+            return release > other.release;
+        }
+        return order > other.order;
+    }
+};
+
+struct ProxyStats {
+    uint64_t received;
+    uint64_t forwarded;
+    uint64_t dropped;
+    uint64_t duplicated;
+    uint64_t reordered;
+
+    ProxyStats() : received(0), forwarded(0), dropped(0), duplicated(0), reordered(0) {}
+};
+
+class ImpairmentProxy {
+private:
+    ImpairmentConfig config;
+    int listenFd;
+    int epollFd;
+    struct sockaddr_in serverAddr;
+    std::unordered_map<uint64_t, ProxySession> sessions;  // Keyed by client addressKey
+    std::unordered_map<int, uint64_t> sessionByFd;
+    std::unordered_map<uint64_t, int> upstreamFds;  // Session id -> socket, only while the session is open
+    uint64_t nextSessionId;
+    std::priority_queue<PendingPacket, std::vector<PendingPacket>, std::greater<PendingPacket>> schedule;
+    std::vector<char> slab;
+    std::vector<uint32_t> freeSlots;
+    std::mt19937_64 gen;
+    std::uniform_real_distribution<double> percent;
+    uint64_t nextOrder;
+    ProxyStats stats;
+    Clock::time_point startTime;
+    std::ofstream log;
+
+    uint32_t allocateSlot() {
+        if (freeSlots.empty()) {
+            uint32_t slot = static_cast<uint32_t>(slab.size() / MAX_BUFFER_SIZE);
+            slab.resize(slab.size() + MAX_BUFFER_SIZE);
+            return slot;
+        }
+        uint32_t slot = freeSlots.back();
+        freeSlots.pop_back();
+        return slot;
+    }
+
+    char* slotData(uint32_t slot) {
+        return slab.data() + static_cast<size_t>(slot) * MAX_BUFFER_SIZE;
+    }
+
+    // One line per decision: microseconds since start, direction, size, action, hold time
+    void logDecision(bool upstream, size_t len, const char* action, double holdMs) {
+        if (!log.is_open()) {
+            return;
+        }
+        std::chrono::duration<double, std::micro> t = Clock::now() - startTime;
+        log << static_cast<uint64_t>(t.count()) << (upstream ? " up " : " down ")
+            << len << " " << action << " " << holdMs << "\n";
+    }
+
+    // Delay for one copy of a packet: base delay plus uniform jitter, never negative
+    double sampleDelay() {
+        double delay = config.delayMs;
+        if (config.jitterMs > 0) {
+            std::uniform_real_distribution<double> jitter(-config.jitterMs, config.jitterMs);
+            delay += jitter(gen);
+        }
+        return std::max(0.0, delay);
+    }
+
+    // A packet held for a session that has since closed is dropped rather
+    // than sent from whatever socket reused its fd
+    void sendNow(uint64_t sessionId, const struct sockaddr_in& dest, const char* data, size_t len) {
+        int fd = listenFd;
+        if (sessionId != 0) {
+            auto it = upstreamFds.find(sessionId);
+            if (it == upstreamFds.end()) {
+                return;
+            }
+            fd = it->second;
+        }
+        sendto(fd, data, len, 0, (const struct sockaddr*)&dest, sizeof(dest));
+        stats.forwarded++;
+    }
+
+    void enqueue(uint64_t sessionId, const struct sockaddr_in& dest, const char* data, size_t len, double holdMs) {
+        if (holdMs <= 0) {
+            sendNow(sessionId, dest, data, len);
+            return;
+        }
+
+        PendingPacket packet;
+        packet.release = Clock::now() + std::chrono::microseconds(static_cast<int64_t>(holdMs * 1000));
+        packet.order = nextOrder++;
+        packet.sessionId = sessionId;
+        packet.dest = dest;
+        packet.slot = allocateSlot();
+        packet.len = static_cast<uint32_t>(len);
+        memcpy(slotData(packet.slot), data, len);
+        schedule.push(packet);
+    }
+
+    // Apply loss, reordering and duplication to one datagram
+    void impair(uint64_t sessionId, const struct sockaddr_in& dest, const char* data, size_t len, bool upstream) {
+        stats.received++;
+
+        if (config.lossPercent > 0 && percent(gen) < config.lossPercent) {
+            stats.dropped++;
+            logDecision(upstream, len, "drop", 0);
+            return;
+        }
+
+        double holdMs = sampleDelay();
+        if (config.reorderPercent > 0 && percent(gen) < config.reorderPercent) {
+            holdMs += config.reorderGapMs;
+            stats.reordered++;
+            logDecision(upstream, len, "reorder", holdMs);
+        } else {
+            logDecision(upstream, len, "pass", holdMs);
+        }
+        enqueue(sessionId, dest, data, len, holdMs);
+
+        if (config.duplicatePercent > 0 && percent(gen) < config.duplicatePercent) {
+            double duplicateHoldMs = sampleDelay();
+            stats.duplicated++;
+            logDecision(upstream, len, "dup", duplicateHoldMs);
+            enqueue(sessionId, dest, data, len, duplicateHoldMs);
+        }
+    }
+
+    // Find or create the upstream socket for a client
+    ProxySession* sessionFor(const struct sockaddr_in& clientAddr) {
+        uint64_t key = addressKey(clientAddr);
+        auto it = sessions.find(key);
+        if (it != sessions.end()) {
+            return &it->second;
+        }
+
+        int fd = socket(AF_INET, SOCK_DGRAM | SOCK_NONBLOCK, 0);
+        if (fd < 0) {
+            std::cerr << "Error creating upstream socket" << std::endl;
+            return nullptr;
+        }
+
+        struct epoll_event event;
+        event.events = EPOLLIN;
+        event.data.fd = fd;
+        epoll_ctl(epollFd, EPOLL_CTL_ADD, fd, &event);
+
+        ProxySession& session = sessions[key];
+        session.id = nextSessionId++;
+        session.clientAddr = clientAddr;
+        session.upstreamFd = fd;
+        session.lastActive = Clock::now();
+        sessionByFd[fd] = key;
+        upstreamFds[session.id] = fd;
+        return &session;
+    }
+
+    // Client -> server
+    void drainListenSocket(char* buffer) {
+        for (int n = 0; n < PROXY_RECEIVE_BURST; n++) {
+            struct sockaddr_in clientAddr;
+            socklen_t addrLen = sizeof(clientAddr);
+            ssize_t bytes = recvfrom(listenFd, buffer, MAX_BUFFER_SIZE, 0,
+                                     (struct sockaddr*)&clientAddr, &addrLen);
+            if (bytes <= 0) {
+                return;
+            }
+
+            ProxySession* session = sessionFor(clientAddr);
+            if (session) {
+                session->lastActive = Clock::now();
+                impair(session->id, serverAddr, buffer, bytes, true);
+            }
+        }
+    }
+
+    // Server -> client
+    void drainUpstreamSocket(int fd, char* buffer) {
+        auto it = sessionByFd.find(fd);
+        if (it == sessionByFd.end()) {
+            return;
+        }
+        ProxySession& session = sessions[it->second];
+
+        for (int n = 0; n < PROXY_RECEIVE_BURST; n++) {
+            ssize_t bytes = recv(fd, buffer, MAX_BUFFER_SIZE, 0);
+            if (bytes <= 0) {
+                return;
+            }
+            session.lastActive = Clock::now();
+            impair(0, session.clientAddr, buffer, bytes, false);
+        }
+    }
+
+    // Send everything whose release time has passed
+    void releaseDue() {
+        auto now = Clock::now();
+        while (!schedule.empty() && schedule.top().release <= now) {
+            const PendingPacket& packet = schedule.top();
+            sendNow(packet.sessionId, packet.dest, slotData(packet.slot), packet.len);
+            freeSlots.push_back(packet.slot);
+            schedule.pop();
+        }
+    }
+
+    // Milliseconds until the next release, rounded up so we never wake early
+    int msUntilNextRelease() {
+        if (schedule.empty()) {
+            return 100;
+        }
+        auto wait = std::chrono::duration_cast<std::chrono::microseconds>(schedule.top().release - Clock::now());
+        if (wait.count() <= 0) {
+            return 0;
+        }
+        return static_cast<int>((wait.count() + 999) / 1000);
+    }
+
+    void closeIdleSessions() {
+        auto now = Clock::now();
+        for (auto it = sessions.begin(); it != sessions.end();) {
+            if (now - it->second.lastActive > std::chrono::seconds(PROXY_IDLE_SECONDS)) {
+                epoll_ctl(epollFd, EPOLL_CTL_DEL, it->second.upstreamFd, nullptr);
+                sessionByFd.erase(it->second.upstreamFd);
+                upstreamFds.erase(it->second.id);
+                close(it->second.upstreamFd);
+                it = sessions.erase(it);
+            } else {
+                ++it;
+            }
+        }
+    }
+
+    void printStats() {
+        std::cout << "Proxy: received " << stats.received << ", forwarded " << stats.forwarded
+                  << ", dropped " << stats.dropped << ", duplicated " << stats.duplicated
+                  << ", reordered " << stats.reordered << ", queued " << schedule.size()
+                  << ", sessions " << sessions.size() << std::endl;
+    }
+
+public:
+    ImpairmentProxy(const ImpairmentConfig& _config)
+        : config(_config), listenFd(-1), epollFd(-1), nextSessionId(1), gen(_config.seed), percent(0.0, 100.0),
+          nextOrder(0), startTime(Clock::now()) {
+        memset(&serverAddr, 0, sizeof(serverAddr));
+    }
+
+    ~ImpairmentProxy() {
+        for (auto& pair : sessions) {
+            close(pair.second.upstreamFd);
+        }
+        if (epollFd >= 0) {
+            close(epollFd);
+        }
+        if (listenFd >= 0) {
+            close(listenFd);
+        }
+    }
+
+    bool init(int listenPort, const std::string& serverIP, int serverPort, const std::string& logPath) {
+        serverAddr.sin_family = AF_INET;
+        serverAddr.sin_port = htons(serverPort);
+        if (inet_pton(AF_INET, serverIP.c_str(), &serverAddr.sin_addr) <= 0) {
+            std::cerr << "Invalid address/ Address not supported" << std::endl;
+            return false;
+        }
+
+        listenFd = socket(AF_INET, SOCK_DGRAM | SOCK_NONBLOCK, 0);
+        if (listenFd < 0) {
+            std::cerr << "Error creating socket" << std::endl;
+            return false;
+        }
+
+        struct sockaddr_in listenAddr;
+        memset(&listenAddr, 0, sizeof(listenAddr));
+        listenAddr.sin_family = AF_INET;
+        listenAddr.sin_addr.s_addr = htonl(INADDR_ANY);
+        listenAddr.sin_port = htons(listenPort);
+        if (bind(listenFd, (struct sockaddr*)&listenAddr, sizeof(listenAddr)) < 0) {
+            std::cerr << "Error binding socket" << std::endl;
+            return false;
+        }
+
+        epollFd = epoll_create1(0);
+        if (epollFd < 0) {
+            std::cerr << "Error creating epoll instance" << std::endl;
+            return false;
+        }
+        struct epoll_event event;
+        event.events = EPOLLIN;
+        event.data.fd = listenFd;
+        epoll_ctl(epollFd, EPOLL_CTL_ADD, listenFd, &event);
+
+        if (!logPath.empty()) {
+            log.open(logPath);
+            if (!log) {
+                std::cerr << "Error opening log file " << logPath << std::endl;
+                return false;
+            }
+        }
+
+        // Everything needed to reproduce the run goes at the top of the log
+        std::ostringstream header;
+        header << "delay " << config.delayMs << "ms, jitter " << config.jitterMs
+               << "ms, loss " << config.lossPercent << "%, dup " << config.duplicatePercent
+               << "%, reorder " << config.reorderPercent << "% (+" << config.reorderGapMs
+               << "ms), seed " << config.seed;
+        std::cout << "Proxy on port " << listenPort << " -> " << serverIP << ":" << serverPort
+                  << " (" << header.str() << ")" << std::endl;
+        if (log.is_open()) {
+            log << "# " << header.str() << "\n";
+        }
+        return true;
+    }
+
+    void run(volatile sig_atomic_t& stopRequested) {
+        std::vector<struct epoll_event> events(PROXY_MAX_EVENTS);
+        char buffer[MAX_BUFFER_SIZE];
+        auto lastStats = Clock::now();
+
+        while (!stopRequested) {
+            int ready = epoll_wait(epollFd, events.data(), PROXY_MAX_EVENTS, msUntilNextRelease());
+            if (ready < 0 && errno != EINTR) {
+                std::cerr << "Epoll error" << std::endl;
+                break;
+            }
+
+            for (int i = 0; i < ready; i++) {
+                if (events[i].data.fd == listenFd) {
+                    drainListenSocket(buffer);
+                } else {
+                    drainUpstreamSocket(events[i].data.fd, buffer);
+                }
+            }
+
+            releaseDue();
+
+            auto now = Clock::now();
+            std::chrono::duration<double> sinceStats = now - lastStats;
+            if (sinceStats.count() >= STATS_INTERVAL_SECONDS) {
+                printStats();
+                closeIdleSessions();
+                lastStats = now;
+            }
+        }
+
+        printStats();
+        log.flush();
+    }
+};
+
+static volatile sig_atomic_t stopRequested = 0;
+
+static void handleStopSignal(int) {
+    stopRequested = 1;
+}
+
+int main(int argc, char* argv[]) {
+    ImpairmentConfig config;
+    int listenPort = DEFAULT_PORT + 1;
+    std::string serverIP = "127.0.0.1";
+    int serverPort = DEFAULT_PORT;
+    std::string logPath;
+
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+
+        if (arg == "--listen" && i + 1 < argc) {
+            listenPort = std::stoi(argv[++i]);
+        } else if (arg == "--server" && i + 1 < argc) {
+            // host:port or just a port on localhost
+            std::string target = argv[++i];
+            size_t colon = target.rfind(':');
+            if (colon == std::string::npos) {
+                serverPort = std::stoi(target);
+            } else {
+                serverIP = target.substr(0, colon);
+                serverPort = std::stoi(target.substr(colon + 1));
+            }
+        } else if (arg == "--delay" && i + 1 < argc) {
+            config.delayMs = std::stod(argv[++i]);
+        } else if (arg == "--jitter" && i + 1 < argc) {
+            config.jitterMs = std::stod(argv[++i]);
+        } else if (arg == "--loss" && i + 1 < argc) {
+            config.lossPercent = std::stod(argv[++i]);
+        } else if (arg == "--dup" && i + 1 < argc) {
+            config.duplicatePercent = std::stod(argv[++i]);
+        } else if (arg == "--reorder" && i + 1 < argc) {
+            config.reorderPercent = std::stod(argv[++i]);
+        } else if (arg == "--reorder-gap" && i + 1 < argc) {
+            config.reorderGapMs = std::stod(argv[++i]);
+        } else if (arg == "--seed" && i + 1 < argc) {
+            config.seed = std::stoull(argv[++i]);
+        } else if (arg == "--log" && i + 1 < argc) {
+            logPath = argv[++i];
+        } else {
+            std::cerr << "Usage: " << argv[0] << " [--listen PORT] [--server HOST:PORT]"
+                      << " [--delay MS] [--jitter MS] [--loss PCT] [--dup PCT]"
+                      << " [--reorder PCT] [--reorder-gap MS] [--seed N] [--log FILE]" << std::endl;
+            return EXIT_FAILURE;
+        }
+    }
+
+    ImpairmentProxy proxy(config);
+    if (!proxy.init(listenPort, serverIP, serverPort, logPath)) {
+        return EXIT_FAILURE;
+    }
+
+    signal(SIGINT, handleStopSignal);
+    signal(SIGTERM, handleStopSignal);
+
+    proxy.run(stopRequested);
+
+    return 0;
+}
@@ -0,0 +1,72 @@
+#ifndef RATE_LIMITER_H
+#define RATE_LIMITER_H
+
+#include <chrono>
+#include <cstdint>
+#include <algorithm>
+#include <vector>
+#include "common.h"
+
+// Token bucket refilled continuously at a fixed rate up to a burst size
+class TokenBucket {
+private:
+    double tokens;
+    double ratePerSecond;
+    double burst;
+    std::chrono::steady_clock::time_point lastRefill;
+
+public:
+    TokenBucket(double _ratePerSecond = INPUT_TOKENS_PER_SECOND, double _burst = INPUT_BURST_TOKENS)
+        : tokens(_burst), ratePerSecond(_ratePerSecond), burst(_burst),
+          lastRefill(std::chrono::steady_clock::now()) {}
+
+    // Take one token if available
+    bool tryConsume(std::chrono::steady_clock::time_point now) {
+        std::chrono::duration<double> elapsed = now - lastRefill;
+        lastRefill = now;
+        tokens = std::min(burst, tokens + elapsed.count() * ratePerSecond);
+
+        if (tokens < 1.0) {
+            return false;
+        }
+
+        tokens -= 1.0;
+        return true;
+    }
+};
+
+// Per-session limiter state, owned by the network thread
+struct InputLimiter {
+    TokenBucket bucket;
+    TokenBucket controlBucket;  // PROBEACK and PING only
+    int playerId;
+    uint64_t accepted;
+    uint64_t dropped;
+    std::chrono::steady_clock::time_point lastSeen;
+
+    InputLimiter(int _playerId = -1, double ratePerSecond = INPUT_TOKENS_PER_SECOND)
+        : bucket(ratePerSecond, INPUT_BURST_TOKENS),
+          controlBucket(CONTROL_TOKENS_PER_SECOND, CONTROL_BURST_TOKENS), playerId(_playerId), accepted(0), dropped(0),
+          lastSeen(std::chrono::steady_clock::now()) {}
+};
+
+// Handshake allowance for senders without a session. The buckets live in a
+// fixed table indexed by a hash of the address, so any number of (possibly
+// spoofed) sources costs no extra memory, and a flooding address only drains
+// its own slot.
+class HandshakeLimiter {
+private:
+    std::vector<TokenBucket> buckets;
+
+public:
+    HandshakeLimiter()
+        : buckets(HANDSHAKE_BUCKET_SLOTS, TokenBucket(HANDSHAKE_TOKENS_PER_SECOND, HANDSHAKE_BURST_TOKENS)) {}
+
+    // Take one token from the address's slot if available
+    bool tryConsume(uint64_t addressKey, std::chrono::steady_clock::time_point now) {
+        size_t slot = (addressKey * 0x9E3779B97F4A7C15ULL) >> 32;
+        return buckets[slot & (HANDSHAKE_BUCKET_SLOTS - 1)].tryConsume(now);
+    }
+};
+
+#endif // RATE_LIMITER_H
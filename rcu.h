@@ -0,0 +1,164 @@
+#ifndef RCU_H
+#define RCU_H
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <iostream>
+#include <vector>
+#include "common.h"
+
+// Single-writer, many-reader publication of immutable values. The writer
+// fills a value, publishes it with one atomic pointer swap and never touches
+// it again; readers pick up the current pointer inside a ReadGuard and never
+// block the writer.
+//
+// Reclamation is epoch based. A reader announces the global epoch in its
+// slot before loading the pointer and clears the slot when done. A value
+// swapped out at epoch E can only still be in use by a reader that announced
+// E or earlier, so once every announced epoch is past E the value is handed
+// back to the writer for reuse. Steady state therefore allocates nothing.
+template <typename T>
+class RcuCell {
+private:
+    struct Retired {
+        T* value;
+        uint64_t epoch;
+    };
+
+    std::atomic<T*> current;
+    std::atomic<uint64_t> globalEpoch;
+    std::array<std::atomic<uint64_t>, RCU_MAX_READERS> readerEpochs;  // 0 when not reading
+    std::array<std::atomic<bool>, RCU_MAX_READERS> slotTaken;
+
+    // Writer only
+    std::vector<Retired> retired;  // Swapped out, possibly still being read
+    std::vector<T*> spare;         // Safe to overwrite and publish again
+
+    void reclaim() {
+        uint64_t oldestReader = UINT64_MAX;
+        for (const std::atomic<uint64_t>& epoch : readerEpochs) {
+            uint64_t announced = epoch.load();
+            if (announced != 0) {
+                oldestReader = std::min(oldestReader, announced);
+            }
+        }
+
+        size_t kept = 0;
+        for (const Retired& entry : retired) {
+            if (entry.epoch < oldestReader) {
+                spare.push_back(entry.value);
+            } else {
+                retired[kept++] = entry;
+            }
+        }
+        retired.resize(kept);
+    }
+
+public:
+    RcuCell() : current(nullptr), globalEpoch(1), readerEpochs(), slotTaken(), retired(), spare() {
+        for (size_t i = 0; i < RCU_MAX_READERS; i++) {
+            readerEpochs[i].store(0);
+            slotTaken[i].store(false);
+        }
+    }
+
+    // Only once no reader or writer uses the cell any more
+    ~RcuCell() {
+        delete current.load();
+        for (const Retired& entry : retired) {
+            delete entry.value;
+        }
+        for (T* value : spare) {
+            delete value;
+        }
+    }
+
+    RcuCell(const RcuCell&) = delete;
+    RcuCell& operator=(const RcuCell&) = delete;
+
+    // Claim a reader slot for one thread; returns -1 when all are taken
+    int registerReader() {
+        for (size_t i = 0; i < RCU_MAX_READERS; i++) {
+            bool expected = false;
+            if (slotTaken[i].compare_exchange_strong(expected, true)) {
+                return static_cast<int>(i);
+            }
+        }
+        std::cerr << "No free snapshot reader slot (RCU_MAX_READERS is " << RCU_MAX_READERS << ")" << std::endl;
+        return -1;
+    }
+
+    void unregisterReader(int slot) {
+        if (slot >= 0) {
+            readerEpochs[slot].store(0);
+            slotTaken[slot].store(false);
+        }
+    }
+
+    // Pins the current value for the guard's lifetime. One guard per slot at a time.
+    class ReadGuard {
+    private:
+        RcuCell& cell;
+        int slot;
+        const T* value;
+
+    public:
+        ReadGuard(RcuCell& _cell, int _slot) : cell(_cell), slot(_slot), value(nullptr) {
+            if (slot < 0) {
+                return;
+            }
+            cell.readerEpochs[slot].store(cell.globalEpoch.load());
+            value = cell.current.load();
+        }
+
+        ~ReadGuard() {
+            if (slot >= 0) {
+                cell.readerEpochs[slot].store(0);
+            }
+        }
+
+        ReadGuard(const ReadGuard&) = delete;
+        ReadGuard& operator=(const ReadGuard&) = delete;
+
+        // Null until the first publish
+        const T* get() const {
+            return value;
+        }
+    };
+
+    // Writer: a value to fill for the next publish, reusing a reclaimed one
+    // when possible. Its previous contents are stale and must be overwritten.
+    T* prepare() {
+        if (spare.empty()) {
+            return new T();
+        }
+        T* value = spare.back();
+        spare.pop_back();
+        return value;
+    }
+
+    // Writer: make value current; it must not be modified afterwards
+    void publish(T* value) {
+        T* old = current.exchange(value);
+        uint64_t epoch = globalEpoch.fetch_add(1);
+        if (old) {
+            retired.push_back(Retired{old, epoch});
+        }
+        reclaim();
+    }
+
+    // Writer: the value it published last, readable without a guard since
+    // only the writer ever reclaims
+    const T* latest() const {
+        return current.load(std::memory_order_relaxed);
+    }
+
+    // Writer: values swapped out but not yet reclaimed
+    size_t getRetiredCount() const {
+        return retired.size();
+    }
+};
+
+#endif // RCU_H
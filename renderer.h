@@ -0,0 +1,177 @@
+#ifndef RENDERER_H
+#define RENDERER_H
+
+#include <string>
+#include <vector>
+#include <chrono>
+#include <cstdint>
+#include <algorithm>
+#include <unistd.h>
+#include "common.h"
+
+// Foreground colors understood by the renderer
+enum class CellColor : uint8_t {
+    DEFAULT,
+    DIM,
+    GREEN,
+    YELLOW,
+    CYAN,
+    RED
+};
+
+// One character cell of the terminal screen
+struct Cell {
+    char ch;
+    CellColor color;
+
+    Cell(char _ch = ' ', CellColor _color = CellColor::DEFAULT) : ch(_ch), color(_color) {}
+
+    bool operator==(const Cell& other) const {
+        return ch == other.ch && color == other.color;
+    }
+
+    bool operator!=(const Cell& other) const {
+        return !(*this == other);
+    }
+};
+
+// Double-buffered ANSI terminal renderer. Callers draw a whole frame into the
+// back buffer; present() diffs it against what is already on screen and emits
+// only the changed cells in a single write.
+class TerminalRenderer {
+private:
+    int width;
+    int height;
+    std::vector<Cell> front;
+    std::vector<Cell> back;
+    bool fullRedraw;
+    std::chrono::steady_clock::duration frameInterval;
+    std::chrono::steady_clock::time_point lastFrame;
+    std::string out;
+
+    // Each code resets first, so bold or dim never carries over to the next colour
+    static const char* colorCode(CellColor color) {
+        switch (color) {
+            case CellColor::DIM: return "\x1b[0;2m";
+            case CellColor::GREEN: return "\x1b[0;1;32m";
+            case CellColor::YELLOW: return "\x1b[0;1;33m";
+            case CellColor::CYAN: return "\x1b[0;36m";
+            case CellColor::RED: return "\x1b[0;1;31m";
+            default: return "\x1b[0m";
+        }
+    }
+
+    // Write the whole output buffer, retrying on short writes
+    void flushOut() {
+        size_t offset = 0;
+        while (offset < out.size()) {
+            ssize_t written = write(STDOUT_FILENO, out.data() + offset, out.size() - offset);
+            if (written <= 0) {
+                break;
+            }
+            offset += written;
+        }
+        out.clear();
+    }
+
+public:
+    TerminalRenderer(int _width, int _height, int fps = RENDER_FPS)
+        : width(_width), height(_height),
+          front(_width * _height), back(_width * _height), fullRedraw(true),
+          frameInterval(std::chrono::microseconds(1000000 / fps)),
+          lastFrame() {
+        out.reserve(_width * _height * 8);
+    }
+
+    // Take over the screen
+    void begin() {
+        out += "\x1b[?25l\x1b[2J";
+        flushOut();
+        fullRedraw = true;
+    }
+
+    // Give the screen back, leaving the cursor below the last frame
+    void end() {
+        out += "\x1b[0m\x1b[" + std::to_string(height + 1) + ";1H\x1b[?25h";
+        flushOut();
+    }
+
+    // Start a new frame in the back buffer
+    void clear() {
+        std::fill(back.begin(), back.end(), Cell());
+    }
+
+    // Draw a single cell
+    void put(int col, int row, char ch, CellColor color = CellColor::DEFAULT) {
+        if (col >= 0 && col < width && row >= 0 && row < height) {
+            back[row * width + col] = Cell(ch, color);
+        }
+    }
+
+    // Draw text starting at a cell, clipped to the screen
+    void text(int col, int row, const std::string& str, CellColor color = CellColor::DEFAULT) {
+        for (size_t i = 0; i < str.size(); i++) {
+            put(col + static_cast<int>(i), row, str[i], color);
+        }
+    }
+
+    // Check whether the frame rate cap allows another frame yet
+    bool frameDue(std::chrono::steady_clock::time_point now) const {
+        return now - lastFrame >= frameInterval;
+    }
+
+    // Milliseconds to wait before the frame rate cap allows another frame
+    int msUntilFrame(std::chrono::steady_clock::time_point now) const {
+        auto remaining = lastFrame + frameInterval - now;
+        if (remaining <= std::chrono::steady_clock::duration::zero()) {
+            return 0;
+        }
+        return static_cast<int>(std::chrono::ceil<std::chrono::milliseconds>(remaining).count());
+    }
+
+    // Emit the cells that differ from the front buffer and swap
+    void present() {
+        CellColor current = CellColor::DEFAULT;
+        int cursorRow = -1;
+        int cursorCol = -1;
+
+        for (int row = 0; row < height; row++) {
+            for (int col = 0; col < width; col++) {
+                const Cell& cell = back[row * width + col];
+                if (!fullRedraw && cell == front[row * width + col]) {
+                    continue;
+                }
+
+                // Reset attributes before the first change of the frame
+                if (cursorRow == -1) {
+                    out += colorCode(current);
+                }
+
+                // Only move the cursor when the next change is not adjacent
+                if (row != cursorRow || col != cursorCol) {
+                    out += "\x1b[" + std::to_string(row + 1) + ";" + std::to_string(col + 1) + "H";
+                }
+                // Blank cells look the same in any foreground color
+                if (cell.color != current && cell.ch != ' ') {
+                    current = cell.color;
+                    out += colorCode(current);
+                }
+
+                out += cell.ch;
+                cursorRow = row;
+                cursorCol = col + 1;
+            }
+        }
+
+        if (!out.empty()) {
+            out += "\x1b[0m";
+            flushOut();
+        }
+
+        front.swap(back);
+        fullRedraw = false;
+        lastFrame = std::chrono::steady_clock::now();
+    }
+};
+
+#endif // RENDERER_H
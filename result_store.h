@@ -0,0 +1,373 @@
+#ifndef RESULT_STORE_H
+#define RESULT_STORE_H
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <ctime>
+#include <deque>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <mutex>
+#include <set>
+#include <shared_mutex>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+#include <fcntl.h>
+#include <unistd.h>
+#include "common.h"
+#include "trace.h"
+
+// One player's line in a finished match
+struct MatchScore {
+    std::string name;
+    int score;
+};
+
+// A finished match as handed to the store by the game thread
+struct MatchRecord {
+    uint64_t matchId;  // Assigned by the store
+    int64_t endedAt;   // Unix seconds
+    std::string winnerName;
+    int winnerScore;
+    std::vector<MatchScore> scores;
+};
+
+// All-time totals for one player name
+struct PlayerTotals {
+    std::string name;
+    int totalScore;
+    int matches;
+    int wins;
+    int bestScore;
+
+    PlayerTotals() : totalScore(0), matches(0), wins(0), bestScore(0) {}
+};
+
+// Write-behind store for match results. The game thread only enqueues; a
+// writer thread batches records into an append-only log, fsyncs once per
+// batch, keeps an in-memory leaderboard index up to date and periodically
+// compacts the log.
+//
+// Log lines:
+//   MATCH id endedAt winner winnerScore n (name score)*
+//   TOTAL name totalScore matches wins bestScore   (folded older matches)
+class ResultStore {
+private:
+    std::string path;
+    int fd;
+
+    // Queue between the game thread and the writer
+    std::mutex queueMutex;
+    std::condition_variable queueCond;
+    std::deque<MatchRecord> queue;
+    bool stopping;
+    uint64_t nextMatchId;
+    std::thread writerThread;
+
+    // Leaderboard index, read concurrently and updated by the writer
+    mutable std::shared_mutex indexMutex;
+    std::unordered_map<std::string, PlayerTotals> totals;
+    std::set<std::pair<int, std::string>, std::greater<std::pair<int, std::string>>> ranking;  // (totalScore, name)
+
+    // Writer thread only: what the next compaction needs
+    std::unordered_map<std::string, PlayerTotals> foldedTotals;  // Matches no longer kept in detail
+    std::deque<MatchRecord> recentMatches;                       // Matches still in the log in detail
+
+    // Names are picked by clients, so several players in one match may share
+    // one. Such a name counts as one match with its best score, and at most
+    // one win.
+    static void addMatch(std::unordered_map<std::string, PlayerTotals>& table, const MatchRecord& record) {
+        std::unordered_map<std::string, int> bestByName;
+        for (const MatchScore& entry : record.scores) {
+            auto inserted = bestByName.emplace(entry.name, entry.score);
+            if (!inserted.second) {
+                inserted.first->second = std::max(inserted.first->second, entry.score);
+            }
+        }
+
+        for (const auto& pair : bestByName) {
+            PlayerTotals& player = table[pair.first];
+            player.name = pair.first;
+            player.totalScore += pair.second;
+            player.matches++;
+            player.bestScore = std::max(player.bestScore, pair.second);
+            if (pair.first == record.winnerName && pair.second == record.winnerScore) {
+                player.wins++;
+            }
+        }
+    }
+
+    // Apply a match to the live index; caller holds indexMutex exclusively
+    void indexMatch(const MatchRecord& record) {
+        for (const MatchScore& entry : record.scores) {
+            auto it = totals.find(entry.name);
+            if (it != totals.end()) {
+                ranking.erase(std::make_pair(it->second.totalScore, entry.name));
+            }
+        }
+        addMatch(totals, record);
+        for (const MatchScore& entry : record.scores) {
+            ranking.insert(std::make_pair(totals[entry.name].totalScore, entry.name));
+        }
+    }
+
+    static std::string formatMatch(const MatchRecord& record) {
+        std::ostringstream line;
+        line << "MATCH " << record.matchId << " " << record.endedAt << " " << record.winnerName << " "
+             << record.winnerScore << " " << record.scores.size();
+        for (const MatchScore& entry : record.scores) {
+            line << " " << entry.name << " " << entry.score;
+        }
+        line << "\n";
+        return line.str();
+    }
+
+    static std::string formatTotals(const PlayerTotals& player) {
+        std::ostringstream line;
+        line << "TOTAL " << player.name << " " << player.totalScore << " " << player.matches << " "
+             << player.wins << " " << player.bestScore << "\n";
+        return line.str();
+    }
+
+    static bool writeAll(int fd, const std::string& data) {
+        size_t written = 0;
+        while (written < data.size()) {
+            ssize_t n = write(fd, data.data() + written, data.size() - written);
+            if (n < 0) {
+                return false;
+            }
+            written += n;
+        }
+        return true;
+    }
+
+    // Rebuild everything from the log. A torn last line from a crash is cut off.
+    void load() {
+        std::ifstream in(path);
+        std::string line;
+        off_t validBytes = 0;
+
+        while (std::getline(in, line)) {
+            if (in.eof()) {
+                // No trailing newline: the write never completed
+                in.close();
+                if (truncate(path.c_str(), validBytes) == 0) {
+                    std::cerr << "Dropped a partial record at the end of " << path << std::endl;
+                }
+                break;
+            }
+            validBytes += line.size() + 1;
+
+            std::istringstream iss(line);
+            std::string type;
+            iss >> type;
+
+            if (type == "TOTAL") {
+                PlayerTotals player;
+                if (iss >> player.name >> player.totalScore >> player.matches >> player.wins >> player.bestScore) {
+                    foldedTotals[player.name] = player;
+                }
+            } else if (type == "MATCH") {
+                MatchRecord record;
+                size_t count = 0;
+                if (!(iss >> record.matchId >> record.endedAt >> record.winnerName >> record.winnerScore >> count)) {
+                    continue;
+                }
+                for (size_t i = 0; i < count; i++) {
+                    MatchScore entry;
+                    if (iss >> entry.name >> entry.score) {
+                        record.scores.push_back(entry);
+                    }
+                }
+                nextMatchId = std::max(nextMatchId, record.matchId + 1);
+                recentMatches.push_back(std::move(record));
+            }
+        }
+
+        std::unique_lock<std::shared_mutex> lock(indexMutex);
+        totals = foldedTotals;
+        for (auto& pair : totals) {
+            ranking.insert(std::make_pair(pair.second.totalScore, pair.first));
+        }
+        for (const MatchRecord& record : recentMatches) {
+            indexMatch(record);
+        }
+    }
+
+    // Fold all but the newest matches into TOTAL lines and atomically replace the log
+    void compact() {
+        while (recentMatches.size() > PERSIST_HISTORY_MATCHES) {
+            addMatch(foldedTotals, recentMatches.front());
+            recentMatches.pop_front();
+        }
+
+        std::string data;
+        for (const auto& pair : foldedTotals) {
+            data += formatTotals(pair.second);
+        }
+        for (const MatchRecord& record : recentMatches) {
+            data += formatMatch(record);
+        }
+
+        std::string tmpPath = path + ".tmp";
+        int tmpFd = ::open(tmpPath.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+        if (tmpFd < 0 || !writeAll(tmpFd, data) || fsync(tmpFd) < 0) {
+            std::cerr << "Error writing compacted results to " << tmpPath << std::endl;
+            if (tmpFd >= 0) {
+                close(tmpFd);
+            }
+            return;
+        }
+        close(tmpFd);
+
+        if (rename(tmpPath.c_str(), path.c_str()) < 0) {
+            std::cerr << "Error replacing " << path << std::endl;
+            return;
+        }
+
+        // Keep appending to the new file
+        close(fd);
+        fd = ::open(path.c_str(), O_WRONLY | O_APPEND | O_CLOEXEC);
+        std::cout << "Compacted results log to " << foldedTotals.size() << " totals and "
+                  << recentMatches.size() << " matches" << std::endl;
+    }
+
+    void writerLoop() {
+        std::vector<MatchRecord> batch;
+        Tracer::nameThread("results");
+
+        while (true) {
+            {
+                std::unique_lock<std::mutex> lock(queueMutex);
+                queueCond.wait(lock, [this] { return stopping || !queue.empty(); });
+
+                // Give records arriving close together a chance to share one fsync
+                if (!stopping) {
+                    queueCond.wait_for(lock, std::chrono::milliseconds(PERSIST_BATCH_MS),
+                                       [this] { return stopping; });
+                }
+
+                if (queue.empty() && stopping) {
+                    return;
+                }
+                batch.assign(std::make_move_iterator(queue.begin()), std::make_move_iterator(queue.end()));
+                queue.clear();
+            }
+
+            TRACE_SPAN("persistBatch");
+            std::string data;
+            for (const MatchRecord& record : batch) {
+                data += formatMatch(record);
+            }
+            if (fd < 0 || !writeAll(fd, data) || fdatasync(fd) < 0) {
+                std::cerr << "Error appending to results log " << path << std::endl;
+            }
+
+            {
+                std::unique_lock<std::shared_mutex> lock(indexMutex);
+                for (const MatchRecord& record : batch) {
+                    indexMatch(record);
+                }
+            }
+
+            for (MatchRecord& record : batch) {
+                recentMatches.push_back(std::move(record));
+            }
+            batch.clear();
+
+            if (recentMatches.size() >= PERSIST_HISTORY_MATCHES + PERSIST_COMPACT_MATCHES) {
+                compact();
+            }
+        }
+    }
+
+public:
+    ResultStore()
+        : fd(-1), stopping(false), nextMatchId(1) {}
+
+    ~ResultStore() {
+        stop();
+    }
+
+    ResultStore(const ResultStore&) = delete;
+    ResultStore& operator=(const ResultStore&) = delete;
+
+    // Load the existing log and start the writer thread
+    bool open(const std::string& _path) {
+        path = _path;
+        load();
+
+        fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+        if (fd < 0) {
+            std::cerr << "Error opening results log " << path << std::endl;
+            return false;
+        }
+
+        writerThread = std::thread(&ResultStore::writerLoop, this);
+        std::cout << "Results log " << path << ": " << recentMatches.size() << " recent matches, "
+                  << getPlayerCount() << " players" << std::endl;
+        return true;
+    }
+
+    // Write out everything still queued, then stop the writer
+    void stop() {
+        {
+            std::lock_guard<std::mutex> lock(queueMutex);
+            stopping = true;
+        }
+        queueCond.notify_one();
+
+        if (writerThread.joinable()) {
+            writerThread.join();
+        }
+        if (fd >= 0) {
+            close(fd);
+            fd = -1;
+        }
+    }
+
+    // Hand a finished match to the writer; never touches the disk
+    void enqueue(MatchRecord record) {
+        {
+            std::lock_guard<std::mutex> lock(queueMutex);
+            record.matchId = nextMatchId++;
+            queue.push_back(std::move(record));
+        }
+        queueCond.notify_one();
+    }
+
+    // Highest all-time totals, best first
+    std::vector<PlayerTotals> topPlayers(size_t count) const {
+        std::shared_lock<std::shared_mutex> lock(indexMutex);
+        std::vector<PlayerTotals> result;
+        for (auto it = ranking.begin(); it != ranking.end() && result.size() < count; ++it) {
+            result.push_back(totals.at(it->second));
+        }
+        return result;
+    }
+
+    // All-time totals for one player name
+    bool lookup(const std::string& name, PlayerTotals& player) const {
+        std::shared_lock<std::shared_mutex> lock(indexMutex);
+        auto it = totals.find(name);
+        if (it == totals.end()) {
+            return false;
+        }
+        player = it->second;
+        return true;
+    }
+
+    size_t getPlayerCount() const {
+        std::shared_lock<std::shared_mutex> lock(indexMutex);
+        return totals.size();
+    }
+};
+
+#endif // RESULT_STORE_H
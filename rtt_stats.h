@@ -0,0 +1,94 @@
+#ifndef RTT_STATS_H
+#define RTT_STATS_H
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include "common.h"
+
+// Round-trip time summary for one session: exact min/avg/max plus a
+// log-bucketed histogram for percentiles. Buckets are 8 per doubling from
+// 10us, so a percentile is accurate to about 9% and the whole thing is a
+// fixed-size array with no allocation per sample.
+class RttStats {
+private:
+    static constexpr int BUCKETS_PER_DOUBLING = 8;
+    static constexpr int BUCKET_COUNT = 21 * BUCKETS_PER_DOUBLING;  // 10us up to ~20s
+    static constexpr double FIRST_BUCKET_MS = 0.01;
+
+    std::array<uint32_t, BUCKET_COUNT> counts;
+    uint64_t samples;
+    double minMs;
+    double maxMs;
+    double sumMs;
+
+    static int bucketFor(double ms) {
+        if (ms <= FIRST_BUCKET_MS) {
+            return 0;
+        }
+        int bucket = static_cast<int>(std::ceil(std::log2(ms / FIRST_BUCKET_MS) * BUCKETS_PER_DOUBLING));
+        return bucket < BUCKET_COUNT ? bucket : BUCKET_COUNT - 1;
+    }
+
+    static double bucketUpperMs(int bucket) {
+        return FIRST_BUCKET_MS * std::exp2(static_cast<double>(bucket) / BUCKETS_PER_DOUBLING);
+    }
+
+public:
+    RttStats() : counts(), samples(0), minMs(std::numeric_limits<double>::max()), maxMs(0), sumMs(0) {}
+
+    void add(double ms) {
+        counts[bucketFor(ms)]++;
+        samples++;
+        minMs = std::min(minMs, ms);
+        maxMs = std::max(maxMs, ms);
+        sumMs += ms;
+    }
+
+    // Fold another session in, e.g. for a server-wide figure
+    void merge(const RttStats& other) {
+        for (int i = 0; i < BUCKET_COUNT; i++) {
+            counts[i] += other.counts[i];
+        }
+        samples += other.samples;
+        minMs = std::min(minMs, other.minMs);
+        maxMs = std::max(maxMs, other.maxMs);
+        sumMs += other.sumMs;
+    }
+
+    uint64_t getSamples() const {
+        return samples;
+    }
+
+    double getMinMs() const {
+        return samples > 0 ? minMs : 0;
+    }
+
+    double getAvgMs() const {
+        return samples > 0 ? sumMs / samples : 0;
+    }
+
+    double getMaxMs() const {
+        return maxMs;
+    }
+
+    // Upper edge of the bucket holding the p-th sample (p in 0..1), capped at the max seen
+    double getPercentileMs(double p) const {
+        if (samples == 0) {
+            return 0;
+        }
+        uint64_t rank = static_cast<uint64_t>(std::ceil(p * samples));
+        uint64_t seen = 0;
+        for (int i = 0; i < BUCKET_COUNT; i++) {
+            seen += counts[i];
+            if (seen >= rank && counts[i] > 0) {
+                return std::min(bucketUpperMs(i), maxMs);
+            }
+        }
+        return maxMs;
+    }
+};
+
+#endif // RTT_STATS_H
@@ -0,0 +1,176 @@
+#ifndef SEND_PACER_H
+#define SEND_PACER_H
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <chrono>
+#include <cstdint>
+#include "common.h"
+#include "rtt_stats.h"
+
+// Limits the pacer adapts within
+struct PacerBounds {
+    int minIntervalMs;
+    int maxIntervalMs;
+    size_t minBudgetBytes;
+    size_t maxBudgetBytes;
+
+    PacerBounds()
+        : minIntervalMs(0), maxIntervalMs(MAX_SEND_INTERVAL_MS),
+          minBudgetBytes(DEFAULT_BUNDLE_MTU), maxBudgetBytes(MAX_SEND_BUDGET_BYTES) {}
+};
+
+// Per-client congestion control for the bundler. The server piggybacks a
+// PROBE on the client's traffic every PROBE_INTERVAL_MS and the client echoes
+// it as PROBEACK. Acks give RTT samples (smoothed like TCP's SRTT/RTTVAR) and
+// unanswered probes count as loss. Flush interval and per-flush byte budget
+// then follow AIMD: a clean ack eases both toward the fast end, while a loss
+// or a sharp RTT rise doubles the interval and halves the budget.
+class SendPacer {
+private:
+    using Clock = std::chrono::steady_clock;
+
+    struct OutstandingProbe {
+        uint32_t seq;
+        Clock::time_point sentAt;
+        bool pending;
+    };
+
+    PacerBounds bounds;
+    double intervalMs;
+    size_t budgetBytes;
+    double srttMs;
+    double rttVarMs;
+    bool haveRtt;
+    double lossRate;  // EWMA of probe outcomes, 0..1
+    uint32_t nextProbeSeq;
+    std::array<OutstandingProbe, PROBE_WINDOW> probes;
+    Clock::time_point nextProbe;
+    Clock::time_point nextFlush;
+    RttStats rttStats;  // Every probe RTT of this session
+
+    void backOff() {
+        intervalMs = std::min<double>(bounds.maxIntervalMs,
+                                      std::max<double>(intervalMs * 2, SEND_INTERVAL_STEP_MS * 4));
+        budgetBytes = std::max(bounds.minBudgetBytes, budgetBytes / 2);
+    }
+
+    void speedUp() {
+        intervalMs = std::max<double>(bounds.minIntervalMs, intervalMs - SEND_INTERVAL_STEP_MS);
+        budgetBytes = std::min(bounds.maxBudgetBytes, budgetBytes + bounds.minBudgetBytes);
+    }
+
+    void recordLoss() {
+        lossRate = lossRate * 0.9 + 0.1;
+        backOff();
+    }
+
+    void recordAck(double sampleMs) {
+        lossRate *= 0.9;
+
+        if (!haveRtt) {
+            srttMs = sampleMs;
+            rttVarMs = sampleMs / 2;
+            haveRtt = true;
+            speedUp();
+            return;
+        }
+
+        // A sample far above the smoothed RTT means queues are building
+        bool queueing = sampleMs > srttMs + 4 * rttVarMs + SEND_INTERVAL_STEP_MS;
+        rttVarMs = 0.75 * rttVarMs + 0.25 * std::abs(srttMs - sampleMs);
+        srttMs = 0.875 * srttMs + 0.125 * sampleMs;
+
+        if (queueing) {
+            backOff();
+        } else {
+            speedUp();
+        }
+    }
+
+    double probeTimeoutMs() const {
+        return std::max<double>(PROBE_TIMEOUT_MIN_MS, haveRtt ? srttMs + 4 * rttVarMs : 0);
+    }
+
+public:
+    SendPacer(const PacerBounds& _bounds = PacerBounds())
+        : bounds(_bounds), intervalMs(_bounds.minIntervalMs), budgetBytes(_bounds.maxBudgetBytes),
+          srttMs(0), rttVarMs(0), haveRtt(false), lossRate(0), nextProbeSeq(1), probes(),
+          nextProbe(Clock::now()), nextFlush(Clock::now()), rttStats() {
+        for (OutstandingProbe& probe : probes) {
+            probe.pending = false;
+        }
+    }
+
+    bool flushDue(Clock::time_point now) const {
+        return now >= nextFlush;
+    }
+
+    void flushed(Clock::time_point now) {
+        nextFlush = now + std::chrono::microseconds(static_cast<int64_t>(intervalMs * 1000));
+    }
+
+    // Returns true and the sequence number when a probe should ride on this flush
+    bool startProbe(Clock::time_point now, uint32_t& seq) {
+        if (now < nextProbe) {
+            return false;
+        }
+        nextProbe = now + std::chrono::milliseconds(PROBE_INTERVAL_MS);
+
+        seq = nextProbeSeq++;
+        OutstandingProbe& slot = probes[seq % PROBE_WINDOW];
+        if (slot.pending) {
+            recordLoss(); // Reusing a slot whose probe was never answered
+        }
+        slot.seq = seq;
+        slot.sentAt = now;
+        slot.pending = true;
+        return true;
+    }
+
+    void onProbeAck(uint32_t seq, Clock::time_point now) {
+        OutstandingProbe& slot = probes[seq % PROBE_WINDOW];
+        if (!slot.pending || slot.seq != seq) {
+            return; // Duplicate or too late
+        }
+        slot.pending = false;
+
+        std::chrono::duration<double, std::milli> rtt = now - slot.sentAt;
+        rttStats.add(rtt.count());
+        recordAck(rtt.count());
+    }
+
+    // Count probes that waited longer than the timeout as lost
+    void expireProbes(Clock::time_point now) {
+        auto timeout = std::chrono::microseconds(static_cast<int64_t>(probeTimeoutMs() * 1000));
+        for (OutstandingProbe& probe : probes) {
+            if (probe.pending && now - probe.sentAt > timeout) {
+                probe.pending = false;
+                recordLoss();
+            }
+        }
+    }
+
+    double getIntervalMs() const {
+        return intervalMs;
+    }
+
+    size_t getBudgetBytes() const {
+        return budgetBytes;
+    }
+
+    double getSrttMs() const {
+        return srttMs;
+    }
+
+    double getLossRate() const {
+        return lossRate;
+    }
+
+    const RttStats& getRttStats() const {
+        return rttStats;
+    }
+};
+
+#endif // SEND_PACER_H
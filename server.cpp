@@ -1,4 +1,61 @@
 #include "server.h"
+#include <cstdlib>
+#include <charconv>
+#include <csignal>
+#include <sys/resource.h>
+
+// Every heap allocation in the process, reported with the periodic stats
+static std::atomic<uint64_t> heapAllocations(0);
+
+void* operator new(size_t size) {
+    heapAllocations.fetch_add(1, std::memory_order_relaxed);
+    if (void* ptr = std::malloc(size ? size : 1)) {
+        return ptr;
+    }
+    throw std::bad_alloc();
+}
+
+// Paired with the operator new above. GCC cannot see that the two are
+// replaced together and flags free() on memory from operator new.
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wmismatched-new-delete"
+void operator delete(void* ptr) noexcept {
+    std::free(ptr);
+}
+
+void operator delete(void* ptr, size_t) noexcept {
+    std::free(ptr);
+}
+#pragma GCC diagnostic pop
+
+// Set by SIGUSR1; the game thread writes the trace at its next tick
+static volatile sig_atomic_t traceDumpRequested = 0;
+
+static void handleTraceSignal(int) {
+    traceDumpRequested = 1;
+}
+
+// Split off the next space-separated token
+static std::string_view nextToken(std::string_view& text) {
+    size_t start = text.find_first_not_of(' ');
+    if (start == std::string_view::npos) {
+        text = std::string_view();
+        return text;
+    }
+    size_t end = text.find(' ', start);
+    std::string_view token = text.substr(start, end == std::string_view::npos ? end : end - start);
+    text = end == std::string_view::npos ? std::string_view() : text.substr(end);
+    return token;
+}
+
+// "min/avg/p99 ms" summary of a set of RTT samples
+static std::string formatRtt(const RttStats& rtt) {
+    char text[96];
+    snprintf(text, sizeof(text), "rtt min/avg/p99 %.2f/%.2f/%.2fms over %llu samples",
+             rtt.getMinMs(), rtt.getAvgMs(), rtt.getPercentileMs(0.99),
+             static_cast<unsigned long long>(rtt.getSamples()));
+    return text;
+}
 
 Position GameServer::generateRandomPosition() {
     std::uniform_int_distribution<> distX(1, MAZE_WIDTH);
@@ -10,14 +67,58 @@ bool GameServer::isValidMove(int x, int y) {
     return x >= 1 && x <= MAZE_WIDTH && y >= 1 && y <= MAZE_HEIGHT;
 }
 
-void GameServer::processMove(int playerId, Direction dir) {
+void GameServer::processMove(int playerId, uint32_t seq, const Direction* dirs, size_t count) {
+    TRACE_SPAN("processMove");
     std::lock_guard<std::mutex> lock(playersMutex);
 
-    if (players.find(playerId) == players.end()) {
-        return; // Player not found
+    auto it = players.find(playerId);
+    if (it == players.end() || count == 0 || seq < count) {
+        return; // Player not found, or a malformed window
+    }
+    Player& player = it->second;
+
+    // dirs[i] is input seq - count + 1 + i; apply each new one once, in order
+    uint32_t firstSeq = seq - static_cast<uint32_t>(count) + 1;
+    if (firstSeq > player.lastInputSeq + 1) {
+        inputsLost.fetch_add(firstSeq - player.lastInputSeq - 1, std::memory_order_relaxed);
+    }
+
+    bool applied = false;
+    for (size_t i = 0; i < count; i++) {
+        uint32_t inputSeq = firstSeq + static_cast<uint32_t>(i);
+        if (inputSeq <= player.lastInputSeq) {
+            inputsDuplicate.fetch_add(1, std::memory_order_relaxed);
+            continue;
+        }
+
+        // Only the newest input is new in this datagram; an older one getting
+        // here means the datagram that first carried it never arrived
+        if (i + 1 < count) {
+            inputsRecovered.fetch_add(1, std::memory_order_relaxed);
+        }
+        inputsApplied.fetch_add(1, std::memory_order_relaxed);
+        player.lastInputSeq = inputSeq;
+        applyMove(player, dirs[i]);
+        applied = true;
     }
 
-    Player& player = players[playerId];
+    // Nothing new means the client is resending because our POS was lost; ack again
+    if (!applied) {
+        queuePosition(player);
+    }
+}
+
+void GameServer::queuePosition(const Player& player) {
+    ClientInfo* clientInfo = udpServer.getClient(player.id);
+    if (clientInfo) {
+        MessageBuilder posMsg(tickArena(), 48);
+        posMsg << "POS " << player.id << ' ' << player.x << ' ' << player.y << ' '
+               << static_cast<size_t>(player.lastInputSeq);
+        udpServer.queueMessage(*clientInfo, posMsg.view(), ReplaceKey::POSITION);
+    }
+}
+
+void GameServer::applyMove(Player& player, Direction dir) {
     int newX = player.x;
     int newY = player.y;
 
@@ -39,79 +140,197 @@ void GameServer::processMove(int playerId, Direction dir) {
     if (isValidMove(newX, newY)) {
         player.x = newX;
         player.y = newY;
+        positionsDirty.store(true, std::memory_order_relaxed);
     }
 
     player.lastActivity = std::chrono::steady_clock::now();
 
     // Send position update to the player
-    std::string posMsg = "POS " + std::to_string(player.id) + " " + 
-                         std::to_string(player.x) + " " + 
-                         std::to_string(player.y);
-
-    ClientInfo* clientInfo = udpServer.getClient(player.id);
-    if (clientInfo) {
-        udpServer.sendMessage(*clientInfo, posMsg);
-    }
+    queuePosition(player);
 
     // Check if player reached treasure
     if (player.x == treasure.x && player.y == treasure.y) {
-        player.score++;
+        collectTreasure(player);
+    }
+}
 
-        // Broadcast collection message
-        std::string collectMsg = "COLLECTED " + std::to_string(player.id) + " " + 
-                                 std::to_string(player.score);
-        udpServer.broadcastMessage(collectMsg);
+void GameServer::collectTreasure(Player& player) {
+    player.score++;
 
-        // Respawn treasure
-        treasure = generateRandomPosition();
+    // Broadcast collection message
+    MessageBuilder collectMsg(tickArena(), 48);
+    collectMsg << "COLLECTED " << player.id << ' ' << player.score;
+    udpServer.queueBroadcast(collectMsg.view());
 
-        // Broadcast new treasure position
-        std::string treasureMsg = "TREASURE " + std::to_string(treasure.x) + " " + 
-                                  std::to_string(treasure.y);
-        udpServer.broadcastMessage(treasureMsg);
+    // Respawn treasure
+    treasure = generateRandomPosition();
+    treasureFieldDirty = true;
 
-        // Broadcast updated scores
-        broadcastScores();
-    }
+    // Broadcast new treasure position
+    MessageBuilder treasureMsg(tickArena(), 48);
+    treasureMsg << "TREASURE " << treasure.x << ' ' << treasure.y;
+    udpServer.queueBroadcast(treasureMsg.view(), ReplaceKey::TREASURE);
+
+    // SCORES goes out from the end-of-tick snapshot
+    scoresDirty.store(true, std::memory_order_relaxed);
 }
 
-void GameServer::broadcastScores() {
-    std::stringstream ss;
-    ss << "SCORES " << players.size();
+void GameServer::spawnBots(int count) {
+    std::lock_guard<std::mutex> lock(playersMutex);
 
-    for (const auto& pair : players) {
-        const Player& player = pair.second;
-        ss << " " << player.id << " " << player.score;
+    for (int i = 0; i < count; i++) {
+        Position startPos = generateRandomPosition();
+        Player bot(nextPlayerId, "bot" + std::to_string(i + 1), startPos.x, startPos.y);
+        players[bot.id] = bot;
+        botIds.push_back(bot.id);
+        nextPlayerId++;
     }
 
-    udpServer.broadcastMessage(ss.str());
+    std::cout << "Spawned " << count << " bots" << std::endl;
 }
 
-void GameServer::checkInactivePlayers() {
+void GameServer::updateBots() {
+    TRACE_SPAN("updateBots");
+    if (botIds.empty()) {
+        return;
+    }
+
     std::lock_guard<std::mutex> lock(playersMutex);
-    auto now = std::chrono::steady_clock::now();
 
-    std::vector<int> playersToRemove;
+    for (int id : botIds) {
+        auto it = players.find(id);
+        if (it == players.end()) {
+            continue;
+        }
 
-    for (const auto& pair : players) {
-        const Player& player = pair.second;
+        // Only a treasure respawn invalidates the shared field
+        if (treasureFieldDirty) {
+            treasureField.recompute(&treasure, 1);
+            treasureFieldDirty = false;
+        }
+
+        // The treasure can respawn on a bot's cell, where there is no step to take
+        Player& bot = it->second;
+        Direction dir;
+        if (bot.x == treasure.x && bot.y == treasure.y) {
+            bot.lastActivity = std::chrono::steady_clock::now();
+            collectTreasure(bot);
+        } else if (treasureField.nextStep(bot.x, bot.y, dir)) {
+            applyMove(bot, dir);
+        }
+    }
+}
+
+void GameServer::broadcastScores(const WorldSnapshot& snapshot) {
+    TRACE_SPAN("broadcast");
+    // With many players (bots) only the top scores fit in one message
+    std::pmr::vector<const SnapshotEntry*> ranked(&tickArena());
+    ranked.reserve(snapshot.players.size());
+    for (const SnapshotEntry& entry : snapshot.players) {
+        ranked.push_back(&entry);
+    }
+
+    size_t count = std::min<size_t>(ranked.size(), MAX_SCORE_ENTRIES);
+    if (count < ranked.size()) {
+        std::partial_sort(ranked.begin(), ranked.begin() + count, ranked.end(),
+                          [](const SnapshotEntry* a, const SnapshotEntry* b) { return a->score > b->score; });
+    }
+
+    MessageBuilder scoresMsg(tickArena(), 32 + count * 24);
+    scoresMsg << "SCORES " << count;
+
+    for (size_t i = 0; i < count; i++) {
+        scoresMsg << ' ' << ranked[i]->id << ' ' << ranked[i]->score;
+    }
+
+    udpServer.queueBroadcast(scoresMsg.view(), ReplaceKey::SCORES);
+}
+
+void GameServer::broadcastPositions(const WorldSnapshot& snapshot) {
+    TRACE_SPAN("broadcast");
+    size_t count = std::min<size_t>(snapshot.players.size(), MAX_VIEW_ENTRIES);
+
+    MessageBuilder playersMsg(tickArena(), 32 + count * 36);
+    playersMsg << "PLAYERS " << count;
+
+    for (size_t i = 0; i < count; i++) {
+        const SnapshotEntry& entry = snapshot.players[i];
+        playersMsg << ' ' << entry.id << ' ' << entry.x << ' ' << entry.y;
+    }
+
+    udpServer.queueBroadcast(playersMsg.view(), ReplaceKey::PLAYERS);
+}
+
+void GameServer::checkInactivePlayers(const WorldSnapshot& snapshot) {
+    TRACE_SPAN("checkInactivePlayers");
+    auto now = std::chrono::steady_clock::now();
+
+    // Scan the snapshot without the lock; it is at most a tick old
+    std::pmr::vector<int> playersToRemove(&tickArena());
+    for (const SnapshotEntry& entry : snapshot.players) {
         auto inactiveTime = std::chrono::duration_cast<std::chrono::seconds>(
-            now - player.lastActivity).count();
+            now - entry.lastActivity).count();
 
-        if (inactiveTime > INACTIVITY_TIMEOUT_SECONDS) {
-            playersToRemove.push_back(player.id);
+        // Bots belong to the server and stay for the whole match
+        if (inactiveTime > INACTIVITY_TIMEOUT_SECONDS &&
+            std::find(botIds.begin(), botIds.end(), entry.id) == botIds.end()) {
+            playersToRemove.push_back(entry.id);
         }
     }
+    if (playersToRemove.empty()) {
+        return;
+    }
 
+    std::lock_guard<std::mutex> lock(playersMutex);
     for (int id : playersToRemove) {
+        // The player may have moved since the snapshot was taken
+        auto it = players.find(id);
+        if (it == players.end() ||
+            now - it->second.lastActivity <= std::chrono::seconds(INACTIVITY_TIMEOUT_SECONDS)) {
+            continue;
+        }
+
         ClientInfo* clientInfo = udpServer.getClient(id);
         if (clientInfo) {
-            std::string kickMsg = "KICK Inactivity timeout";
-            udpServer.sendMessage(*clientInfo, kickMsg);
+            RttStats rtt;
+            if (udpServer.getSessionRtt(id, rtt) && rtt.getSamples() > 0) {
+                std::cout << "Player " << id << " session ended: " << formatRtt(rtt) << std::endl;
+            }
+            udpServer.queueMessage(*clientInfo, "KICK Inactivity timeout");
             udpServer.removeClient(id);
         }
         players.erase(id);
+        positionsDirty.store(true, std::memory_order_relaxed);
+    }
+}
+
+const WorldSnapshot& GameServer::publishSnapshot() {
+    TRACE_SPAN("publishSnapshot");
+    // A recycled snapshot keeps its vector and name capacity, so this rarely allocates
+    WorldSnapshot* snapshot = worldSnapshots.prepare();
+    snapshot->tick = tickCount;
+    snapshot->takenAt = std::chrono::steady_clock::now();
+
+    {
+        std::lock_guard<std::mutex> lock(playersMutex);
+        snapshot->treasure = treasure;
+        snapshot->players.resize(players.size());
+
+        size_t i = 0;
+        for (const auto& pair : players) {
+            const Player& player = pair.second;
+            SnapshotEntry& entry = snapshot->players[i++];
+            entry.id = player.id;
+            entry.x = player.x;
+            entry.y = player.y;
+            entry.score = player.score;
+            entry.name = player.username;
+            entry.lastActivity = player.lastActivity;
+        }
     }
+
+    worldSnapshots.publish(snapshot);
+    return *snapshot;
 }
 
 bool GameServer::isGameOver() {
@@ -123,35 +342,82 @@ bool GameServer::isGameOver() {
 }
 
 void GameServer::endGame() {
-    std::lock_guard<std::mutex> lock(playersMutex);
+    TRACE_SPAN("endGame");
+
+    // Results come from one final snapshot rather than the live player map
+    const WorldSnapshot& snapshot = publishSnapshot();
 
     // Find winner
     int winnerId = -1;
     int highestScore = -1;
 
-    for (const auto& pair : players) {
-        const Player& player = pair.second;
-        if (player.score > highestScore) {
-            highestScore = player.score;
-            winnerId = player.id;
+    for (const SnapshotEntry& entry : snapshot.players) {
+        if (entry.score > highestScore) {
+            highestScore = entry.score;
+            winnerId = entry.id;
+        }
+    }
+
+    // Hand the result to the background writer; no disk I/O on this thread
+    if (!snapshot.players.empty()) {
+        MatchRecord record;
+        record.endedAt = std::chrono::duration_cast<std::chrono::seconds>(
+            std::chrono::system_clock::now().time_since_epoch()).count();
+        record.winnerScore = highestScore;
+        record.scores.reserve(snapshot.players.size());
+        for (const SnapshotEntry& entry : snapshot.players) {
+            std::string name = entry.name.empty() ? "player" + std::to_string(entry.id) : entry.name;
+            if (entry.id == winnerId) {
+                record.winnerName = name;
+            }
+            record.scores.push_back(MatchScore{name, entry.score});
+        }
+        resultStore.enqueue(std::move(record));
+    }
+
+    // Per-session network quality, to tell network lag from server lag
+    for (const SessionRtt& session : udpServer.getSessionRtts()) {
+        if (session.rtt.getSamples() > 0) {
+            std::cout << "Player " << session.playerId << " session: " << formatRtt(session.rtt) << std::endl;
         }
     }
 
     // Broadcast game over message
-    std::string gameOverMsg = "GAMEOVER " + std::to_string(winnerId) + " " + 
-                             std::to_string(highestScore);
-    udpServer.broadcastMessage(gameOverMsg);
+    MessageBuilder gameOverMsg(tickArena(), 48);
+    gameOverMsg << "GAMEOVER " << winnerId << ' ' << highestScore;
+    udpServer.queueBroadcast(gameOverMsg.view());
+    udpServer.flushBundles(true);
+    spectatorRelay.broadcast(gameOverMsg.view());
 
     running = false;
 }
 
 // Assuming the class declaration order is: udpServer, running, players, treasure, nextPlayerId, gameStartTime, playersMutex, rd, gen
-GameServer::GameServer(int port) 
-    : udpServer(port), running(false), players(), nextPlayerId(1),
+GameServer::GameServer(const ServerConfig& _config)
+    : config(_config), udpServer(config.port, config.bundleMtu, config.useIoUring, config.shardName), running(false), players(), nextPlayerId(1),
       rd(), gen(rd()), treasure(generateRandomPosition()),
-      gameStartTime(), playersMutex() {
+      gameStartTime(), playersMutex(), inputLimiters(),
+      lastLimiterSweep(std::chrono::steady_clock::now()),
+      handshakeLimiter(), handshakesDropped(0), cookieIssuer(),
+      lastStatsTime(std::chrono::steady_clock::now()), lastStatsReceived(0), lastStatsSent(0),
+      lastStatsCpuSeconds(0.0), lastStatsAllocations(0), tickCount(0), lastStatsTicks(0), botIds(), treasureField(), treasureFieldDirty(true),
+      scoresDirty(false), positionsDirty(false), inputsApplied(0), inputsRecovered(0), inputsDuplicate(0), inputsLost(0),
+      worldSnapshots(),
+      spectatorRelay(udpServer, worldSnapshots, config.spectatorRate, config.spectatorDelayMs, config.bundleMtu) {
+
+    PacerBounds bounds;
+    bounds.maxIntervalMs = config.maxSendIntervalMs;
+    bounds.minBudgetBytes = config.bundleMtu;
+    bounds.maxBudgetBytes = std::max(config.bundleMtu, config.maxSendBudget);
+    udpServer.setPacerBounds(bounds);
+
+    if (config.busyPoll) {
+        udpServer.enableBusyPoll(config.busyPollUsec);
+    }
 
-    std::cout << "Game server started on port " << port << std::endl;
+    tracer().setEnabled(config.trace);
+
+    std::cout << "Game server started on port " << config.port << std::endl;
 }
 
 
@@ -159,9 +425,33 @@ void GameServer::start() {
     running = true;
     gameStartTime = std::chrono::steady_clock::now();
 
+    if (config.botCount > 0) {
+        spawnBots(config.botCount);
+    }
+
+    // Earlier results load before play starts; writes happen on a background thread
+    if (resultStore.open(config.resultsPath)) {
+        printLeaders();
+    }
+
+    // Spectators are served from their own thread
+    spectatorRelay.start();
+
     // Start game loop in a separate thread
     std::thread gameThread(&GameServer::gameLoop, this);
 
+    // Optional pinning; messageLoop runs on this thread
+    if (config.networkCpu >= 0 && pinThreadToCpu(pthread_self(), config.networkCpu)) {
+        std::cout << "Network thread pinned to CPU " << config.networkCpu << std::endl;
+    }
+    if (config.gameCpu >= 0 && pinThreadToCpu(gameThread.native_handle(), config.gameCpu)) {
+        std::cout << "Game thread pinned to CPU " << config.gameCpu << std::endl;
+    }
+    if (config.busyPoll && config.networkCpu >= 0 && config.networkCpu == config.gameCpu) {
+        std::cout << "Warning: the busy-polling network thread shares CPU " << config.networkCpu
+                  << " with the game thread, ticks will be delayed" << std::endl;
+    }
+
     // Start message handling loop
     messageLoop();
 
@@ -169,94 +459,460 @@ void GameServer::start() {
     if (gameThread.joinable()) {
         gameThread.join();
     }
+
+    spectatorRelay.stop();
+
+    // Let the writer finish this match's record before exiting
+    resultStore.stop();
+    printLeaders();
+
+    tracer().waitForDump();
+    if (tracer().isEnabled()) {
+        tracer().dump(config.tracePath);
+    }
+}
+
+void GameServer::printLeaders() {
+    std::vector<PlayerTotals> leaders = resultStore.topPlayers(LEADERBOARD_ENTRIES);
+    if (leaders.empty()) {
+        return;
+    }
+
+    std::cout << "All-time leaders:" << std::endl;
+    for (size_t i = 0; i < leaders.size(); i++) {
+        const PlayerTotals& player = leaders[i];
+        std::cout << "  " << (i + 1) << ". " << player.name << ": " << player.totalScore << " points, "
+                  << player.wins << "/" << player.matches << " wins, best " << player.bestScore << std::endl;
+    }
+}
+
+void GameServer::printStats() {
+    auto now = std::chrono::steady_clock::now();
+    std::chrono::duration<double> elapsed = now - lastStatsTime;
+    if (elapsed.count() < STATS_INTERVAL_SECONDS) {
+        return;
+    }
+
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    double cpuSeconds = usage.ru_utime.tv_sec + usage.ru_utime.tv_usec / 1e6 +
+                        usage.ru_stime.tv_sec + usage.ru_stime.tv_usec / 1e6;
+
+    uint64_t received = udpServer.getDatagramsReceived();
+    uint64_t sent = udpServer.getDatagramsSent();
+    double cpuUsed = cpuSeconds - lastStatsCpuSeconds;
+    uint64_t packets = (received - lastStatsReceived) + (sent - lastStatsSent);
+    uint64_t allocations = heapAllocations.load(std::memory_order_relaxed);
+    uint64_t ticks = tickCount - lastStatsTicks;
+
+    std::cout << "Stats: rx " << static_cast<uint64_t>((received - lastStatsReceived) / elapsed.count())
+              << "/s, tx " << static_cast<uint64_t>((sent - lastStatsSent) / elapsed.count())
+              << "/s, cpu " << static_cast<int>(100.0 * cpuUsed / elapsed.count()) << "%, "
+              << static_cast<uint64_t>(cpuUsed > 0 ? packets / cpuUsed : 0) << " packets per cpu-second, "
+              << (ticks > 0 ? (allocations - lastStatsAllocations) / ticks : 0) << " heap allocs per tick, "
+              << (worldSnapshots.latest() ? worldSnapshots.latest()->players.size() : 0) << " players, "
+              << spectatorRelay.getSpectatorCount() << " spectators"
+              << std::endl;
+
+    uint64_t applied = inputsApplied.load(std::memory_order_relaxed);
+    if (applied > 0) {
+        std::cout << "Inputs: " << applied << " applied, " << inputsRecovered.load(std::memory_order_relaxed)
+                  << " recovered from redundant copies, " << inputsLost.load(std::memory_order_relaxed)
+                  << " lost, " << inputsDuplicate.load(std::memory_order_relaxed) << " duplicates ignored"
+                  << std::endl;
+    }
+
+    PacingSummary pacing = udpServer.getPacingSummary();
+    if (pacing.clients > 0) {
+        std::cout << "Pacing: " << pacing.clients << " clients, send interval avg "
+                  << static_cast<int>(pacing.avgIntervalMs) << "ms (max " << static_cast<int>(pacing.maxIntervalMs)
+                  << "ms), budget avg " << static_cast<uint64_t>(pacing.avgBudgetBytes) << "B, srtt avg "
+                  << pacing.avgSrttMs << "ms, loss avg " << static_cast<int>(pacing.avgLossRate * 100)
+                  << "%, " << pacing.dropped << " messages dropped, " << formatRtt(pacing.rtt) << std::endl;
+    }
+
+    lastStatsTime = now;
+    lastStatsReceived = received;
+    lastStatsSent = sent;
+    lastStatsCpuSeconds = cpuSeconds;
+    lastStatsAllocations = allocations;
+    lastStatsTicks = tickCount;
+}
+
+void GameServer::handleTraceRequest() {
+    if (!traceDumpRequested) {
+        return;
+    }
+    traceDumpRequested = 0;
+
+    // The first signal on an untraced server only starts recording
+    if (!tracer().isEnabled()) {
+        tracer().setEnabled(true);
+        std::cout << "Tracing started, send SIGUSR1 again to write " << config.tracePath << std::endl;
+        return;
+    }
+    tracer().dumpAsync(config.tracePath);
 }
 
 void GameServer::gameLoop() {
-    while (running) {
-        // Check for inactive players
-        checkInactivePlayers();
+    Tracer::nameThread("game");
 
-        // Check if game is over
-        if (isGameOver()) {
-            endGame();
-            break;
+    while (running) {
+        {
+            TRACE_SPAN("tick");
+
+            // Move server-side bots
+            updateBots();
+
+            // Publish this tick's world; everything below reads the snapshot
+            // instead of holding playersMutex
+            const WorldSnapshot& snapshot = publishSnapshot();
+
+            if (scoresDirty.exchange(false, std::memory_order_relaxed)) {
+                broadcastScores(snapshot);
+            }
+            if (positionsDirty.exchange(false, std::memory_order_relaxed)) {
+                broadcastPositions(snapshot);
+            }
+
+            // Check for inactive players
+            checkInactivePlayers(snapshot);
+
+            // Check if game is over
+            if (isGameOver()) {
+                endGame();
+                break;
+            }
+
+            // Send everything this tick produced
+            udpServer.flushBundles();
+            tickArena().reset();
+            tickCount++;
         }
 
+        printStats();
+        handleTraceRequest();
+
         // Sleep for a short time
         std::this_thread::sleep_for(std::chrono::milliseconds(100));
     }
 }
 
+bool GameServer::admitDatagram(std::string_view message, ClientInfo& clientInfo) {
+    std::string_view type = nextToken(message);
+
+    auto now = std::chrono::steady_clock::now();
+    uint64_t key = addressKey(clientInfo.addr);
+    auto it = inputLimiters.find(key);
+    if (it == inputLimiters.end()) {
+        // Unknown sender: only the handshakes, which keep no state until the cookie checks out
+        clientInfo.playerId = -1;
+        if (type != "JOIN" && type != "SPECTATE") {
+            return false;
+        }
+        if (handshakeLimiter.tryConsume(key, now)) {
+            return true;
+        }
+
+        handshakesDropped++;
+        if (handshakesDropped == 1 || handshakesDropped % 1000 == 0) {
+            std::cout << "Rate limiting handshakes: " << handshakesDropped << " dropped" << std::endl;
+        }
+        return false;
+    }
+
+    InputLimiter& limiter = it->second;
+    limiter.lastSeen = now;
+    clientInfo.playerId = limiter.playerId;
+
+    TokenBucket& bucket = (type == "PROBEACK" || type == "PING") ? limiter.controlBucket : limiter.bucket;
+    if (bucket.tryConsume(now)) {
+        limiter.accepted++;
+        return true;
+    }
+
+    limiter.dropped++;
+    if (limiter.dropped == 1 || limiter.dropped % 1000 == 0) {
+        std::cout << "Rate limiting player " << limiter.playerId << ": "
+                  << limiter.dropped << " datagrams dropped" << std::endl;
+    }
+    return false;
+}
+
+void GameServer::sweepInputLimiters() {
+    auto now = std::chrono::steady_clock::now();
+    if (now - lastLimiterSweep < std::chrono::seconds(1)) {
+        return;
+    }
+    lastLimiterSweep = now;
+
+    for (auto it = inputLimiters.begin(); it != inputLimiters.end();) {
+        const InputLimiter& limiter = it->second;
+        auto idleTime = std::chrono::duration_cast<std::chrono::seconds>(
+            now - limiter.lastSeen).count();
+
+        if (idleTime > INACTIVITY_TIMEOUT_SECONDS) {
+            if (limiter.dropped > 0) {
+                std::cout << "Player " << limiter.playerId << " input: " << limiter.accepted
+                          << " accepted, " << limiter.dropped << " dropped" << std::endl;
+            }
+            it = inputLimiters.erase(it);
+        } else {
+            ++it;
+        }
+    }
+}
+
 void GameServer::messageLoop() {
     std::string message;
     ClientInfo clientInfo;
+    Tracer::nameThread("network");
 
     while (running) {
+        // Wait for the first datagram, then drain whatever else is already queued
         if (udpServer.receiveMessage(message, clientInfo)) {
-            processMessage(message, clientInfo);
+            TRACE_SPAN("burst");
+            int handled = 0;
+            do {
+                if (admitDatagram(message, clientInfo)) {
+                    processMessage(message, clientInfo);
+                }
+            } while (++handled < MAX_RECEIVE_BURST && udpServer.tryReceiveMessage(message, clientInfo));
+
+            // Replies from the whole burst leave as one bundle per client
+            udpServer.flushBundles();
+            tickArena().reset();
         }
+
+        sweepInputLimiters();
     }
 }
 
-void GameServer::processMessage(const std::string& message, ClientInfo& clientInfo) {
-    std::istringstream iss(message);
-    std::string type;
-    iss >> type;
+void GameServer::handleJoin(std::istringstream& iss, ClientInfo& clientInfo) {
+    std::string username;
+    std::string cookie;
+    iss >> username >> cookie;
 
-    if (type == "JOIN") {
-        std::string username;
-        iss >> username;
+    // First step: answer with a cookie and keep no state for this sender
+    if (!cookieIssuer.verify(clientInfo.addr, cookie)) {
+        std::string challengeMsg = "CHALLENGE " + cookieIssuer.issue(clientInfo.addr);
+        udpServer.sendMessage(clientInfo, challengeMsg);
+        return;
+    }
 
-        // Create new player
-        Position startPos = generateRandomPosition();
-        Player newPlayer(nextPlayerId, username, startPos.x, startPos.y);
+    Player newPlayer;
+    bool rejoin = false;
 
-        {
-            std::lock_guard<std::mutex> lock(playersMutex);
+    {
+        std::lock_guard<std::mutex> lock(playersMutex);
+
+        // A retransmitted JOIN from an address that already has a player gets its WELCOME again
+        auto limiterIt = inputLimiters.find(addressKey(clientInfo.addr));
+        if (limiterIt != inputLimiters.end()) {
+            auto playerIt = players.find(limiterIt->second.playerId);
+            if (playerIt != players.end()) {
+                newPlayer = playerIt->second;
+                rejoin = true;
+            }
+        }
+
+        if (!rejoin) {
+            // Create new player
+            Position startPos = generateRandomPosition();
+            newPlayer = Player(nextPlayerId, username, startPos.x, startPos.y);
             players[newPlayer.id] = newPlayer;
+
+            // Increment player ID for next player
+            nextPlayerId++;
         }
 
         // Register client
         clientInfo.playerId = newPlayer.id;
         udpServer.registerClient(newPlayer.id, clientInfo);
+    }
 
-        // Send welcome message
-        std::string welcomeMsg = "WELCOME " + std::to_string(newPlayer.id) + " " +
-                                std::to_string(newPlayer.x) + " " +
-                                std::to_string(newPlayer.y);
-        udpServer.sendMessage(clientInfo, welcomeMsg);
+    // Start rate limiting this address; a repeated JOIN keeps its bucket
+    auto limiterIt = inputLimiters.emplace(addressKey(clientInfo.addr),
+                                           InputLimiter(newPlayer.id, config.inputRate)).first;
+    limiterIt->second.playerId = newPlayer.id;
 
-        // Send treasure position
-        std::string treasureMsg = "TREASURE " + std::to_string(treasure.x) + " " +
-                                 std::to_string(treasure.y);
-        udpServer.sendMessage(clientInfo, treasureMsg);
+    // Send welcome message
+    MessageBuilder welcomeMsg(tickArena(), 48);
+    welcomeMsg << "WELCOME " << newPlayer.id << ' ' << newPlayer.x << ' ' << newPlayer.y;
+    udpServer.queueMessage(clientInfo, welcomeMsg.view());
 
-        // Broadcast updated scores
-        broadcastScores();
+    // Send treasure position
+    MessageBuilder treasureMsg(tickArena(), 48);
+    treasureMsg << "TREASURE " << treasure.x << ' ' << treasure.y;
+    udpServer.queueMessage(clientInfo, treasureMsg.view(), ReplaceKey::TREASURE);
 
-        // Increment player ID for next player
-        nextPlayerId++;
+    // Everyone gets the new scoreboard and positions at the end of the tick
+    if (!rejoin) {
+        scoresDirty.store(true, std::memory_order_relaxed);
+    }
+    positionsDirty.store(true, std::memory_order_relaxed);
+}
+
+void GameServer::handleSpectate(std::string_view cookie, const ClientInfo& clientInfo) {
+    // Spectators never become players; the relay owns them from here
+    if (!cookieIssuer.verify(clientInfo.addr, std::string(cookie))) {
+        std::string challengeMsg = "CHALLENGE " + cookieIssuer.issue(clientInfo.addr);
+        udpServer.sendMessage(clientInfo, challengeMsg);
+        return;
+    }
+
+    spectatorRelay.addSpectator(clientInfo);
+}
+
+void GameServer::handleLeaders(const ClientInfo& clientInfo) {
+    // Only joined players may ask, so the larger reply cannot be aimed at a spoofed address
+    if (inputLimiters.find(addressKey(clientInfo.addr)) == inputLimiters.end()) {
+        return;
+    }
+
+    std::vector<PlayerTotals> leaders = resultStore.topPlayers(LEADERBOARD_ENTRIES);
+    std::string leadersMsg = "LEADERS " + std::to_string(leaders.size());
+    for (const PlayerTotals& player : leaders) {
+        leadersMsg += " " + player.name + " " + std::to_string(player.totalScore) + " " + std::to_string(player.wins);
+    }
+    udpServer.queueMessage(clientInfo, leadersMsg);
+}
+
+void GameServer::handlePing(std::string_view clientTime, const ClientInfo& clientInfo) {
+    int64_t receivedAt = wallClockMicros();
+
+    // Same rule as LEADERS: never answer an address that has not joined
+    if (inputLimiters.find(addressKey(clientInfo.addr)) == inputLimiters.end()) {
+        return;
+    }
+    int64_t t0;
+    if (std::from_chars(clientTime.data(), clientTime.data() + clientTime.size(), t0).ec != std::errc()) {
+        return;
+    }
+
+    // Sent straight away rather than bundled, so the send time is accurate
+    char pongMsg[80];
+    int len = snprintf(pongMsg, sizeof(pongMsg), "PONG %lld %lld %lld", static_cast<long long>(t0),
+                       static_cast<long long>(receivedAt), static_cast<long long>(wallClockMicros()));
+    udpServer.sendMessage(clientInfo, std::string_view(pongMsg, len));
+}
+
+void GameServer::processMessage(const std::string& message, ClientInfo& clientInfo) {
+    TRACE_SPAN("processMessage");
+    std::string_view rest(message);
+    std::string_view type = nextToken(rest);
+
+    if (type == "JOIN") {
+        std::istringstream iss(message);
+        std::string joinType;
+        iss >> joinType;
+        handleJoin(iss, clientInfo);
     }
     else if (type == "MOVE") {
+        // MOVE id seq count dir*, parsed in place without a stream or string copies
         int playerId;
-        std::string dirStr;
-        iss >> playerId >> dirStr;
+        uint32_t seq;
+        size_t count;
+        Direction dirs[MAX_REDUNDANT_INPUTS];
+        {
+            TRACE_SPAN("decode");
+            std::string_view idStr = nextToken(rest);
+            std::string_view seqStr = nextToken(rest);
+            std::string_view countStr = nextToken(rest);
+
+            if (std::from_chars(idStr.data(), idStr.data() + idStr.size(), playerId).ec != std::errc() ||
+                std::from_chars(seqStr.data(), seqStr.data() + seqStr.size(), seq).ec != std::errc() ||
+                std::from_chars(countStr.data(), countStr.data() + countStr.size(), count).ec != std::errc() ||
+                count > MAX_REDUNDANT_INPUTS) {
+                return;
+            }
+            // Only the address that joined as this player may move it
+            if (playerId != clientInfo.playerId) {
+                return;
+            }
+            for (size_t i = 0; i < count; i++) {
+                std::string_view dirStr = nextToken(rest);
+                if (dirStr.empty()) {
+                    return;
+                }
+                dirs[i] = stringToDirection(dirStr);
+            }
+        }
 
-        Direction dir = stringToDirection(dirStr);
-        processMove(playerId, dir);
+        processMove(playerId, seq, dirs, count);
+    }
+    else if (type == "SPECTATE") {
+        handleSpectate(nextToken(rest), clientInfo);
+    }
+    else if (type == "LEADERS") {
+        handleLeaders(clientInfo);
+    }
+    else if (type == "PING") {
+        handlePing(nextToken(rest), clientInfo);
+    }
+    else if (type == "PROBEACK") {
+        std::string_view seqStr = nextToken(rest);
+        uint32_t seq;
+        if (std::from_chars(seqStr.data(), seqStr.data() + seqStr.size(), seq).ec == std::errc()) {
+            udpServer.handleProbeAck(clientInfo, seq);
+        }
     }
 }
 int main(int argc, char* argv[]) {
-    int port = DEFAULT_PORT;
-
-    // Allow optional port specification
-    if (argc > 1) {
-        port = std::stoi(argv[1]);
+    ServerConfig config;
+
+    // Optional port, followed by optional flags
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+
+        if (arg == "--mtu" && i + 1 < argc) {
+            config.bundleMtu = std::stoul(argv[++i]);
+        } else if (arg == "--io-uring") {
+            config.useIoUring = true;
+        } else if (arg == "--bots" && i + 1 < argc) {
+            config.botCount = std::stoi(argv[++i]);
+        } else if (arg == "--input-rate" && i + 1 < argc) {
+            config.inputRate = std::stod(argv[++i]);
+        } else if (arg == "--spectator-rate" && i + 1 < argc) {
+            config.spectatorRate = std::stod(argv[++i]);
+        } else if (arg == "--spectator-delay" && i + 1 < argc) {
+            config.spectatorDelayMs = std::stoi(argv[++i]);
+        } else if (arg == "--max-send-interval" && i + 1 < argc) {
+            config.maxSendIntervalMs = std::stoi(argv[++i]);
+        } else if (arg == "--max-send-budget" && i + 1 < argc) {
+            config.maxSendBudget = std::stoul(argv[++i]);
+        } else if (arg == "--busy-poll") {
+            config.busyPoll = true;
+        } else if (arg == "--busy-poll-usec" && i + 1 < argc) {
+            config.busyPollUsec = std::stoi(argv[++i]);
+        } else if (arg == "--net-cpu" && i + 1 < argc) {
+            config.networkCpu = std::stoi(argv[++i]);
+        } else if (arg == "--game-cpu" && i + 1 < argc) {
+            config.gameCpu = std::stoi(argv[++i]);
+        } else if (arg == "--trace") {
+            config.trace = true;
+        } else if (arg == "--trace-file" && i + 1 < argc) {
+            config.tracePath = argv[++i];
+        } else if (arg == "--results" && i + 1 < argc) {
+            config.resultsPath = argv[++i];
+        } else if (arg == "--shard" && i + 1 < argc) {
+            config.shardName = argv[++i];
+
+            // Shards keep separate logs unless told otherwise; the name is "shardN-<gateway pid>"
+            if (config.resultsPath == DEFAULT_RESULTS_PATH) {
+                config.resultsPath = "maze_results-" + config.shardName.substr(0, config.shardName.find('-')) + ".log";
+            }
+        } else {
+            config.port = std::stoi(arg);
+        }
     }
 
-    std::cout << "Starting maze game server on port " << port << std::endl;
+    std::cout << "Starting maze game server on port " << config.port << std::endl;
+
+    // SIGUSR1 starts tracing, or writes the trace if it is already on
+    signal(SIGUSR1, handleTraceSignal);
 
-    GameServer server(port);
+    GameServer server(config);
     server.start();
 
     return 0;
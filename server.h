@@ -10,11 +10,52 @@
 #include <thread>
 #include <chrono>
 #include <mutex>
+#include <unordered_map>
+#include <atomic>
 #include "common.h"
 #include "udp_helper.h"
+#include "rate_limiter.h"
+#include "cookie.h"
+#include "flow_field.h"
+#include "arena.h"
+#include "spectator_relay.h"
+#include "result_store.h"
+#include "clock_sync.h"
+#include "trace.h"
+#include "rcu.h"
+
+// Startup options for the game server
+struct ServerConfig {
+    int port;
+    size_t bundleMtu;
+    bool useIoUring;
+    double inputRate;  // Datagrams per second allowed per client
+    int botCount;
+    std::string shardName;  // Non-empty when spawned by the gateway
+    double spectatorRate;   // Snapshots per second sent to spectators
+    int spectatorDelayMs;   // How far behind live play spectators are kept
+    std::string resultsPath;  // Append-only match results log
+    int maxSendIntervalMs;    // Slowest per-client flush interval the pacer may pick
+    size_t maxSendBudget;     // Largest per-client bytes per flush
+    bool busyPoll;            // Spin on recvmmsg instead of sleeping in select()
+    int busyPollUsec;         // SO_BUSY_POLL value in busy-poll mode, 0 to leave unset
+    int networkCpu;           // CPU to pin the network thread to, -1 for none
+    int gameCpu;              // CPU to pin the game thread to, -1 for none
+    bool trace;               // Record trace spans from startup
+    std::string tracePath;    // Where trace dumps are written
+
+    ServerConfig()
+        : port(DEFAULT_PORT), bundleMtu(DEFAULT_BUNDLE_MTU), useIoUring(false),
+          inputRate(INPUT_TOKENS_PER_SECOND), botCount(0), shardName(),
+          spectatorRate(DEFAULT_SPECTATOR_RATE), spectatorDelayMs(0), resultsPath(DEFAULT_RESULTS_PATH),
+          maxSendIntervalMs(MAX_SEND_INTERVAL_MS), maxSendBudget(MAX_SEND_BUDGET_BYTES),
+          busyPoll(false), busyPollUsec(0), networkCpu(-1), gameCpu(-1),
+          trace(false), tracePath(DEFAULT_TRACE_PATH) {}
+};
 
 class GameServer {
 private:
+ServerConfig config;
 UDPServer udpServer;
 bool running;
 std::map<int, Player> players;
@@ -24,6 +65,30 @@ std::mt19937 gen;
 Position treasure;
 std::chrono::steady_clock::time_point gameStartTime;
 std::mutex playersMutex;
+std::unordered_map<uint64_t, InputLimiter> inputLimiters;  // Keyed by addressKey, network thread only
+std::chrono::steady_clock::time_point lastLimiterSweep;
+HandshakeLimiter handshakeLimiter;  // Handshakes from unknown senders, network thread only
+uint64_t handshakesDropped;
+CookieIssuer cookieIssuer;
+std::chrono::steady_clock::time_point lastStatsTime;
+uint64_t lastStatsReceived;
+uint64_t lastStatsSent;
+double lastStatsCpuSeconds;
+uint64_t lastStatsAllocations;
+uint64_t tickCount;
+uint64_t lastStatsTicks;
+std::vector<int> botIds;
+FlowField treasureField;  // Shared by every bot, rebuilt when the treasure moves
+bool treasureFieldDirty;
+std::atomic<bool> scoresDirty;  // Set by either thread, SCORES goes out at the end of the tick
+std::atomic<bool> positionsDirty;  // Likewise for PLAYERS, when anyone moved, joined or left
+std::atomic<uint64_t> inputsApplied;    // Sequenced MOVE inputs, counted by the network thread
+std::atomic<uint64_t> inputsRecovered;  // Applied from a later datagram's redundant copy
+std::atomic<uint64_t> inputsDuplicate;  // Already applied, ignored
+std::atomic<uint64_t> inputsLost;       // Skipped because they fell out of every window
+RcuCell<WorldSnapshot> worldSnapshots;  // Published by the game thread every tick
+SpectatorRelay spectatorRelay;
+ResultStore resultStore;
 
 
     // Generate random position within maze bounds
@@ -32,14 +97,39 @@ std::mutex playersMutex;
     // Check if move is valid
     bool isValidMove(int x, int y);
 
-    // Process player movement
-    void processMove(int playerId, Direction dir);
+    // Apply a MOVE's input window (oldest first, the last is seq), skipping
+    // inputs the player already had applied
+    void processMove(int playerId, uint32_t seq, const Direction* dirs, size_t count);
+
+    // Move a player and handle treasure pickup; caller holds playersMutex.
+    // A score change only marks SCORES for the end of the tick.
+    void applyMove(Player& player, Direction dir);
+
+    // Queue the player's position and input ack; caller holds playersMutex
+    void queuePosition(const Player& player);
+
+    // Score the treasure for a player on its cell and respawn it; caller
+    // holds playersMutex
+    void collectTreasure(Player& player);
+
+    // Add server-side bot players
+    void spawnBots(int count);
 
-    // Broadcast scores to all players
-    void broadcastScores();
+    // Step every bot one cell along the treasure flow field, or pick up the
+    // treasure if it respawned under the bot
+    void updateBots();
 
-    // Check for inactive players
-    void checkInactivePlayers();
+    // Broadcast the snapshot's scores to all players
+    void broadcastScores(const WorldSnapshot& snapshot);
+
+    // Broadcast the snapshot's player positions, so clients can draw each other
+    void broadcastPositions(const WorldSnapshot& snapshot);
+
+    // Kick players the snapshot shows as inactive, rechecked under the lock
+    void checkInactivePlayers(const WorldSnapshot& snapshot);
+
+    // Publish an immutable copy of the world for readers on any thread
+    const WorldSnapshot& publishSnapshot();
 
     // Check if game is over
     bool isGameOver();
@@ -47,17 +137,48 @@ std::mutex playersMutex;
     // End the game
     void endGame();
 
+    // Apply the sender's token bucket before a datagram is decoded. Pacer and
+    // clock-sync replies draw from their own bucket: dropping them for input
+    // spam would read as network loss and slow the client's sends. Unknown
+    // senders may only JOIN or SPECTATE; for known ones clientInfo.playerId
+    // is set to the player that address joined as.
+    bool admitDatagram(std::string_view message, ClientInfo& clientInfo);
+
+    // Forget limiter state for senders that have gone quiet
+    void sweepInputLimiters();
+
+    // Act on a pending SIGUSR1: start tracing, or write the trace file
+    void handleTraceRequest();
+
+    // Print throughput and CPU use every STATS_INTERVAL_SECONDS
+    void printStats();
+
     // Message handling loop
     void messageLoop();
 
     // Game loop for periodic updates
     void gameLoop();
 
+    // Handle a JOIN, answering with a cookie until the client echoes a valid one
+    void handleJoin(std::istringstream& iss, ClientInfo& clientInfo);
+
+    // Subscribe a spectator to the relay, with the same cookie handshake as JOIN
+    void handleSpectate(std::string_view cookie, const ClientInfo& clientInfo);
+
+    // Answer a joined player's request for the all-time leaderboard
+    void handleLeaders(const ClientInfo& clientInfo);
+
+    // Answer a joined client's PING with PONG t0 t1 t2 for its clock estimate
+    void handlePing(std::string_view clientTime, const ClientInfo& clientInfo);
+
+    // Print the all-time leaderboard to stdout
+    void printLeaders();
+
     // Process received message
     void processMessage(const std::string& message, ClientInfo& clientInfo);
 
 public:
-    GameServer(int port = DEFAULT_PORT);
+    GameServer(const ServerConfig& config = ServerConfig());
 
     // Start the game server
     void start();
@@ -0,0 +1,228 @@
+#ifndef SHM_RING_H
+#define SHM_RING_H
+
+#include <atomic>
+#include <string>
+#include <cstring>
+#include <cstdint>
+#include <iostream>
+#include <mutex>
+#include <new>
+#include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/mman.h>
+#include <sys/eventfd.h>
+#include <netinet/in.h>
+#include "common.h"
+
+// One datagram plus the client address it came from or goes to
+struct RingSlot {
+    uint32_t len;
+    struct sockaddr_in addr;
+    char data[MAX_BUFFER_SIZE];
+};
+
+// Shared indices, each on its own cache line
+struct RingHeader {
+    alignas(64) std::atomic<uint64_t> head;   // Next slot to read, written by the consumer
+    alignas(64) std::atomic<uint64_t> tail;   // Next slot to write, written by the producer
+    alignas(64) std::atomic<uint32_t> consumerWaiting;
+};
+
+// Lock-free single-producer/single-consumer ring of datagrams in POSIX shared
+// memory. A consumer that runs out of work sets consumerWaiting and sleeps on
+// an eventfd doorbell; the producer only rings it when that flag is set, so a
+// busy ring costs no syscalls.
+class ShmRing {
+private:
+    RingHeader* header;
+    RingSlot* slots;
+    size_t mapSize;
+    int doorbellFd;
+
+    bool map(const std::string& name, bool create) {
+        int flags = create ? (O_CREAT | O_RDWR | O_TRUNC) : O_RDWR;
+        int fd = shm_open(name.c_str(), flags, 0600);
+        if (fd < 0) {
+            std::cerr << "Error opening shared memory " << name << std::endl;
+            return false;
+        }
+
+        mapSize = sizeof(RingHeader) + sizeof(RingSlot) * SHM_RING_SLOTS;
+        if (create && ftruncate(fd, mapSize) < 0) {
+            std::cerr << "Error sizing shared memory " << name << std::endl;
+            close(fd);
+            return false;
+        }
+
+        void* mem = mmap(nullptr, mapSize, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        close(fd);
+        if (mem == MAP_FAILED) {
+            std::cerr << "Error mapping shared memory " << name << std::endl;
+            return false;
+        }
+
+        header = static_cast<RingHeader*>(mem);
+        slots = reinterpret_cast<RingSlot*>(static_cast<char*>(mem) + sizeof(RingHeader));
+
+        if (create) {
+            new (header) RingHeader();
+            header->head.store(0);
+            header->tail.store(0);
+            header->consumerWaiting.store(0);
+        }
+        return true;
+    }
+
+public:
+    ShmRing() : header(nullptr), slots(nullptr), mapSize(0), doorbellFd(-1) {}
+
+    ~ShmRing() {
+        if (header) {
+            munmap(header, mapSize);
+        }
+    }
+
+    ShmRing(const ShmRing&) = delete;
+    ShmRing& operator=(const ShmRing&) = delete;
+
+    // Create and zero the segment (gateway side)
+    bool create(const std::string& name, int _doorbellFd) {
+        doorbellFd = _doorbellFd;
+        return map(name, true);
+    }
+
+    // Attach to a segment created by the gateway (shard side)
+    bool attach(const std::string& name, int _doorbellFd) {
+        doorbellFd = _doorbellFd;
+        return map(name, false);
+    }
+
+    // Producer: copy a datagram in. Returns false when the ring is full.
+    bool push(const struct sockaddr_in& addr, const char* data, size_t len) {
+        uint64_t tail = header->tail.load(std::memory_order_relaxed);
+        if (tail - header->head.load(std::memory_order_acquire) >= SHM_RING_SLOTS || len > MAX_BUFFER_SIZE) {
+            return false;
+        }
+
+        RingSlot& slot = slots[tail % SHM_RING_SLOTS];
+        slot.len = static_cast<uint32_t>(len);
+        slot.addr = addr;
+        memcpy(slot.data, data, len);
+        header->tail.store(tail + 1, std::memory_order_seq_cst);
+
+        // Pairs with the fence in prepareWait so a sleeping consumer is never missed
+        if (header->consumerWaiting.load(std::memory_order_seq_cst)) {
+            ringDoorbell();
+        }
+        return true;
+    }
+
+    // Consumer: take the oldest datagram, if any
+    bool pop(struct sockaddr_in& addr, std::string& message) {
+        uint64_t head = header->head.load(std::memory_order_relaxed);
+        if (head == header->tail.load(std::memory_order_acquire)) {
+            return false;
+        }
+
+        const RingSlot& slot = slots[head % SHM_RING_SLOTS];
+        addr = slot.addr;
+        message.assign(slot.data, slot.len);
+        header->head.store(head + 1, std::memory_order_release);
+        return true;
+    }
+
+    // Drop everything queued and return how many there were. Only while no
+    // consumer is attached, e.g. after a shard exited.
+    size_t discard() {
+        uint64_t head = header->head.load(std::memory_order_relaxed);
+        uint64_t tail = header->tail.load(std::memory_order_acquire);
+        header->head.store(tail, std::memory_order_release);
+        return static_cast<size_t>(tail - head);
+    }
+
+    // Sequentially consistent so a consumer checking after prepareWait sees any racing push
+    bool empty() const {
+        return header->head.load(std::memory_order_relaxed) == header->tail.load(std::memory_order_seq_cst);
+    }
+
+    // Wake the consumer. A failed write means the counter is already nonzero,
+    // so the consumer will wake anyway.
+    void ringDoorbell() {
+        uint64_t one = 1;
+        ssize_t written = write(doorbellFd, &one, sizeof(one));
+        (void)written;
+    }
+
+    // Consumer: announce that it is about to sleep on the doorbell
+    void prepareWait() {
+        header->consumerWaiting.store(1, std::memory_order_seq_cst);
+    }
+
+    // Consumer: back to polling the ring directly
+    void finishWait() {
+        header->consumerWaiting.store(0, std::memory_order_relaxed);
+    }
+
+    int getDoorbell() const {
+        return doorbellFd;
+    }
+};
+
+// Drain an eventfd doorbell after waking
+inline void clearDoorbell(int fd) {
+    uint64_t count;
+    while (read(fd, &count, sizeof(count)) > 0) {
+    }
+}
+
+// A shard's side of its two rings: datagrams from the gateway come in on one,
+// replies go back on the other. Several threads may send, so sends are serialized.
+class ShardLink {
+private:
+    ShmRing inbound;
+    ShmRing outbound;
+    std::mutex sendMutex;
+
+public:
+    bool attach(const std::string& shardName) {
+        return inbound.attach(shardRingName(shardName, true), SHARD_INBOUND_DOORBELL_FD) &&
+               outbound.attach(shardRingName(shardName, false), SHARD_OUTBOUND_DOORBELL_FD);
+    }
+
+    // Ring names shared by the gateway and a shard
+    static std::string shardRingName(const std::string& shardName, bool inboundRing) {
+        return "/maze-" + shardName + (inboundRing ? "-in" : "-out");
+    }
+
+    // Receive one datagram, sleeping on the doorbell up to timeoutMs if none is queued
+    bool receive(std::string& message, struct sockaddr_in& addr, int timeoutMs) {
+        if (inbound.pop(addr, message)) {
+            return true;
+        }
+        if (timeoutMs <= 0) {
+            return false;
+        }
+
+        inbound.prepareWait();
+        if (inbound.empty()) {
+            struct pollfd pfd;
+            pfd.fd = inbound.getDoorbell();
+            pfd.events = POLLIN;
+            poll(&pfd, 1, timeoutMs);
+            clearDoorbell(pfd.fd);
+        }
+        inbound.finishWait();
+
+        return inbound.pop(addr, message);
+    }
+
+    // Queue a reply for the gateway to send
+    bool send(const struct sockaddr_in& addr, const char* data, size_t len) {
+        std::lock_guard<std::mutex> lock(sendMutex);
+        return outbound.push(addr, data, len);
+    }
+};
+
+#endif // SHM_RING_H
@@ -0,0 +1,200 @@
+#ifndef SPECTATOR_RELAY_H
+#define SPECTATOR_RELAY_H
+
+#include <atomic>
+#include <chrono>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+#include "common.h"
+#include "udp_helper.h"
+#include "trace.h"
+#include "rcu.h"
+
+// A viewer that sent SPECTATE and keeps it alive by repeating it
+struct Spectator {
+    ClientInfo info;
+    std::chrono::steady_clock::time_point lastSeen;
+};
+
+// Serves spectators from its own thread. It reads the world snapshots the
+// game thread publishes each tick, picks the one to show (optionally
+// delayed), encodes it once and sends it to every spectator at its own rate.
+class SpectatorRelay {
+private:
+    UDPServer& udpServer;
+    RcuCell<WorldSnapshot>& snapshots;
+    int readerSlot;  // Relay thread's reader slot in snapshots
+    double rateHz;
+    int delayMs;
+    size_t mtu;
+    std::deque<WorldSnapshot> history;  // Relay thread only, copies kept for the delay, oldest first
+    std::unordered_map<uint64_t, Spectator> spectators;  // Keyed by addressKey
+    std::mutex spectatorsMutex;
+    std::atomic<size_t> spectatorCount;
+    std::atomic<bool> running;
+    std::thread relayThread;
+    uint64_t lastSentTick;
+    std::vector<std::string> chunks;       // Encoded datagrams for the current snapshot
+    std::vector<ClientInfo> recipients;    // Copy of the spectator list taken each round
+
+    // Newest snapshot at least delayMs old, dropping history nobody will need
+    // again. Without a delay this is the guarded current snapshot itself;
+    // with one, published snapshots are copied so the guard can be released.
+    const WorldSnapshot* pickSnapshot(const WorldSnapshot* current, std::chrono::steady_clock::time_point now) {
+        if (!current) {
+            return nullptr;
+        }
+        if (delayMs <= 0) {
+            history.clear();
+            return current;
+        }
+
+        if (history.empty() || history.back().tick != current->tick) {
+            history.push_back(*current);
+        }
+
+        auto cutoff = now - std::chrono::milliseconds(delayMs);
+        while (history.size() > 1 && history[1].takenAt <= cutoff) {
+            history.pop_front();
+        }
+        return history.front().takenAt <= cutoff ? &history.front() : nullptr;
+    }
+
+    // Split a snapshot into self-contained datagrams of at most mtu bytes:
+    // SNAPSHOT tick chunk chunks treasureX treasureY count (id x y score)*
+    void encode(const WorldSnapshot& snapshot) {
+        std::vector<std::string> bodies(1);
+        std::vector<size_t> counts(1, 0);
+        size_t headerRoom = 64;
+
+        for (const SnapshotEntry& entry : snapshot.players) {
+            std::string item = " " + std::to_string(entry.id) + " " + std::to_string(entry.x) + " " +
+                               std::to_string(entry.y) + " " + std::to_string(entry.score);
+            if (counts.back() > 0 && headerRoom + bodies.back().size() + item.size() > mtu) {
+                bodies.emplace_back();
+                counts.push_back(0);
+            }
+            bodies.back() += item;
+            counts.back()++;
+        }
+
+        chunks.clear();
+        for (size_t i = 0; i < bodies.size(); i++) {
+            chunks.push_back("SNAPSHOT " + std::to_string(snapshot.tick) + " " + std::to_string(i) + " " +
+                             std::to_string(bodies.size()) + " " + std::to_string(snapshot.treasure.x) + " " +
+                             std::to_string(snapshot.treasure.y) + " " + std::to_string(counts[i]) + bodies[i]);
+        }
+    }
+
+    // Drop spectators that stopped refreshing, then copy the rest for sending
+    void collectRecipients(std::chrono::steady_clock::time_point now) {
+        std::lock_guard<std::mutex> lock(spectatorsMutex);
+        recipients.clear();
+
+        for (auto it = spectators.begin(); it != spectators.end();) {
+            if (now - it->second.lastSeen > std::chrono::seconds(INACTIVITY_TIMEOUT_SECONDS)) {
+                it = spectators.erase(it);
+            } else {
+                recipients.push_back(it->second.info);
+                ++it;
+            }
+        }
+        spectatorCount.store(spectators.size(), std::memory_order_relaxed);
+    }
+
+    void relayLoop() {
+        auto interval = std::chrono::microseconds(static_cast<int64_t>(1e6 / rateHz));
+        auto nextRound = std::chrono::steady_clock::now();
+        Tracer::nameThread("spectators");
+        readerSlot = snapshots.registerReader();
+
+        while (running) {
+            nextRound += interval;
+            std::this_thread::sleep_until(nextRound);
+            TRACE_SPAN("spectatorRound");
+
+            auto now = std::chrono::steady_clock::now();
+            collectRecipients(now);
+            if (recipients.empty()) {
+                history.clear();
+                continue;
+            }
+
+            {
+                // Held only while choosing and encoding, never across sends
+                RcuCell<WorldSnapshot>::ReadGuard guard(snapshots, readerSlot);
+                const WorldSnapshot* snapshot = pickSnapshot(guard.get(), now);
+                if (!snapshot || snapshot->tick == lastSentTick) {
+                    continue;
+                }
+
+                encode(*snapshot);
+                lastSentTick = snapshot->tick;
+            }
+
+            for (const ClientInfo& spectator : recipients) {
+                for (const std::string& chunk : chunks) {
+                    udpServer.sendMessage(spectator, chunk);
+                }
+            }
+        }
+
+        snapshots.unregisterReader(readerSlot);
+    }
+
+public:
+    SpectatorRelay(UDPServer& _udpServer, RcuCell<WorldSnapshot>& _snapshots, double _rateHz, int _delayMs, size_t _mtu)
+        : udpServer(_udpServer), snapshots(_snapshots), readerSlot(-1),
+          rateHz(_rateHz > 0 ? _rateHz : DEFAULT_SPECTATOR_RATE),
+          delayMs(_delayMs), mtu(_mtu), history(), spectators(), spectatorsMutex(),
+          spectatorCount(0), running(false), relayThread(), lastSentTick(UINT64_MAX), chunks(), recipients() {}
+
+    ~SpectatorRelay() {
+        stop();
+    }
+
+    void start() {
+        running = true;
+        relayThread = std::thread(&SpectatorRelay::relayLoop, this);
+    }
+
+    void stop() {
+        running = false;
+        if (relayThread.joinable()) {
+            relayThread.join();
+        }
+    }
+
+    size_t getSpectatorCount() const {
+        return spectatorCount.load(std::memory_order_relaxed);
+    }
+
+    // Add a spectator or refresh an existing one, and confirm the relay settings
+    void addSpectator(const ClientInfo& clientInfo) {
+        {
+            std::lock_guard<std::mutex> lock(spectatorsMutex);
+            Spectator& spectator = spectators[addressKey(clientInfo.addr)];
+            spectator.info = clientInfo;
+            spectator.lastSeen = std::chrono::steady_clock::now();
+            spectatorCount.store(spectators.size(), std::memory_order_relaxed);
+        }
+
+        int intervalMs = static_cast<int>(1000.0 / rateHz);
+        udpServer.sendMessage(clientInfo, "SPECTATING " + std::to_string(intervalMs) + " " + std::to_string(delayMs));
+    }
+
+    // Send a one-off message, such as GAMEOVER, to every spectator right away
+    void broadcast(std::string_view message) {
+        std::lock_guard<std::mutex> lock(spectatorsMutex);
+        for (const auto& pair : spectators) {
+            udpServer.sendMessage(pair.second.info, message);
+        }
+    }
+};
+
+#endif // SPECTATOR_RELAY_H
@@ -0,0 +1,255 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include <unistd.h>
+#include "common.h"
+
+// Span profiler for the server pipeline. TRACE_SPAN("name") records how long
+// the enclosing scope took into the calling thread's own ring buffer, so
+// after a thread's first span nothing locks or allocates; the ring keeps the newest
+// TRACE_RING_EVENTS spans. dump() writes every thread's ring as Chrome
+// trace-event JSON, which chrome://tracing or Perfetto can open; dumpAsync()
+// does so from a helper thread. When tracing is off a span costs one relaxed
+// load and a branch.
+class Tracer {
+private:
+    // A seqlock per slot lets dump() read while the owner overwrites: stamp
+    // is odd during a write and 2k once the slot's k-th write is complete, so
+    // a reader knows both that the slot was stable and which span it holds
+    struct Event {
+        std::atomic<uint64_t> stamp;
+        std::atomic<const char*> name;
+        std::atomic<uint64_t> startNs;
+        std::atomic<uint64_t> durationNs;
+    };
+
+    struct CopiedSpan {
+        const char* name;
+        uint64_t startNs;
+        uint64_t durationNs;
+    };
+
+    // One per thread that ever recorded a span. Never freed, so a ring can
+    // still be dumped after its thread exits.
+    struct ThreadRing {
+        int tid;
+        std::string threadName;
+        std::unique_ptr<Event[]> events;
+        std::atomic<uint64_t> head;  // Spans ever written; only the owning thread stores
+
+        ThreadRing(int _tid, const std::string& _threadName)
+            : tid(_tid), threadName(_threadName), events(new Event[TRACE_RING_EVENTS]()), head(0) {}
+    };
+
+    std::atomic<bool> enabled;
+    std::mutex ringsMutex;  // Guards rings; only taken on a thread's first span and by dump()
+    std::vector<ThreadRing*> rings;
+    std::chrono::steady_clock::time_point origin;
+    std::thread dumpThread;
+    std::atomic<bool> dumpInProgress;
+
+    static thread_local ThreadRing* threadRing;
+    static thread_local const char* pendingThreadName;
+
+    ThreadRing* ringForThisThread() {
+        if (!threadRing) {
+            std::lock_guard<std::mutex> lock(ringsMutex);
+            int tid = static_cast<int>(rings.size()) + 1;
+            threadRing = new ThreadRing(tid, pendingThreadName ? pendingThreadName : "thread" + std::to_string(tid));
+            rings.push_back(threadRing);
+        }
+        return threadRing;
+    }
+
+public:
+    Tracer()
+        : enabled(false), ringsMutex(), rings(), origin(std::chrono::steady_clock::now()), dumpThread(),
+          dumpInProgress(false) {}
+
+    ~Tracer() {
+        waitForDump();
+    }
+
+    Tracer(const Tracer&) = delete;
+    Tracer& operator=(const Tracer&) = delete;
+
+    bool isEnabled() const {
+        return enabled.load(std::memory_order_relaxed);
+    }
+
+    void setEnabled(bool on) {
+        enabled.store(on, std::memory_order_relaxed);
+    }
+
+    // Label the calling thread in dumps; call before its first span
+    static void nameThread(const char* name) {
+        pendingThreadName = name;
+    }
+
+    uint64_t nowNs() const {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now() - origin).count();
+    }
+
+    // Append a finished span to the calling thread's ring
+    void record(const char* name, uint64_t startNs, uint64_t endNs) {
+        ThreadRing* ring = ringForThisThread();
+        uint64_t index = ring->head.load(std::memory_order_relaxed);
+        Event& event = ring->events[index % TRACE_RING_EVENTS];
+        uint64_t stamp = event.stamp.load(std::memory_order_relaxed);
+
+        event.stamp.store(stamp + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        event.name.store(name, std::memory_order_relaxed);
+        event.startNs.store(startNs, std::memory_order_relaxed);
+        event.durationNs.store(endNs - startNs, std::memory_order_relaxed);
+        event.stamp.store(stamp + 2, std::memory_order_release);
+        ring->head.store(index + 1, std::memory_order_release);
+    }
+
+    // Copy span i of a ring; false if the owner has overwritten it since
+    static bool copySpan(const ThreadRing& ring, uint64_t i, CopiedSpan& span) {
+        const Event& event = ring.events[i % TRACE_RING_EVENTS];
+        uint64_t expected = 2 * (i / TRACE_RING_EVENTS + 1);
+
+        if (event.stamp.load(std::memory_order_acquire) != expected) {
+            return false;
+        }
+        span.name = event.name.load(std::memory_order_relaxed);
+        span.startNs = event.startNs.load(std::memory_order_relaxed);
+        span.durationNs = event.durationNs.load(std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_acquire);
+        return event.stamp.load(std::memory_order_relaxed) == expected;
+    }
+
+    // Write every ring as trace-event JSON. Safe while other threads keep
+    // recording; spans overwritten while being copied are skipped.
+    bool dump(const std::string& path) {
+        std::vector<ThreadRing*> snapshot;
+        {
+            std::lock_guard<std::mutex> lock(ringsMutex);
+            snapshot = rings;
+        }
+
+        // Copy first so the rings are read in one quick pass, not between writes
+        std::vector<std::vector<CopiedSpan>> copies(snapshot.size());
+        for (size_t r = 0; r < snapshot.size(); r++) {
+            const ThreadRing& ring = *snapshot[r];
+            uint64_t head = ring.head.load(std::memory_order_acquire);
+            uint64_t first = head > TRACE_RING_EVENTS ? head - TRACE_RING_EVENTS : 0;
+
+            copies[r].reserve(head - first);
+            CopiedSpan span;
+            for (uint64_t i = first; i < head; i++) {
+                if (copySpan(ring, i, span)) {
+                    copies[r].push_back(span);
+                }
+            }
+        }
+
+        FILE* out = fopen(path.c_str(), "w");
+        if (!out) {
+            std::cerr << "Error opening trace file " << path << std::endl;
+            return false;
+        }
+
+        int pid = static_cast<int>(getpid());
+        size_t spans = 0;
+        fprintf(out, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n");
+        for (size_t r = 0; r < snapshot.size(); r++) {
+            const ThreadRing& ring = *snapshot[r];
+
+            // Thread metadata first; every span below then starts with a comma
+            fprintf(out, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%d,\"tid\":%d,\"args\":{\"name\":\"%s\"}}",
+                    r > 0 ? ",\n" : "", pid, ring.tid, ring.threadName.c_str());
+
+            for (const CopiedSpan& span : copies[r]) {
+                fprintf(out, ",\n{\"name\":\"%s\",\"ph\":\"X\",\"pid\":%d,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f}",
+                        span.name, pid, ring.tid, span.startNs / 1000.0, span.durationNs / 1000.0);
+            }
+            spans += copies[r].size();
+        }
+        fprintf(out, "\n]}\n");
+
+        bool ok = fclose(out) == 0;
+        if (ok) {
+            std::cout << "Wrote " << spans << " trace spans to " << path << std::endl;
+        } else {
+            std::cerr << "Error writing trace file " << path << std::endl;
+        }
+        return ok;
+    }
+
+    // dump() on a helper thread, so a tick never waits on copying or file
+    // I/O. Skipped if the previous dump is still being written.
+    bool dumpAsync(const std::string& path) {
+        if (dumpInProgress.load()) {
+            std::cerr << "Trace dump still in progress, skipping" << std::endl;
+            return false;
+        }
+        waitForDump();
+
+        dumpInProgress.store(true);
+        dumpThread = std::thread([this, path]() {
+            dump(path);
+            dumpInProgress.store(false);
+        });
+        return true;
+    }
+
+    // Block until a dumpAsync() has finished
+    void waitForDump() {
+        if (dumpThread.joinable()) {
+            dumpThread.join();
+        }
+    }
+};
+
+inline thread_local Tracer::ThreadRing* Tracer::threadRing = nullptr;
+inline thread_local const char* Tracer::pendingThreadName = nullptr;
+
+// The process-wide tracer
+inline Tracer& tracer() {
+    static Tracer instance;
+    return instance;
+}
+
+// Records the lifetime of a scope; name must be a string literal
+class TraceSpan {
+private:
+    const char* name;
+    uint64_t startNs;
+
+public:
+    explicit TraceSpan(const char* _name) : name(nullptr), startNs(0) {
+        if (tracer().isEnabled()) {
+            name = _name;
+            startNs = tracer().nowNs();
+        }
+    }
+
+    ~TraceSpan() {
+        if (name) {
+            tracer().record(name, startNs, tracer().nowNs());
+        }
+    }
+
+    TraceSpan(const TraceSpan&) = delete;
+    TraceSpan& operator=(const TraceSpan&) = delete;
+};
+
+#define TRACE_CONCAT_INNER(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_INNER(a, b)
+#define TRACE_SPAN(name) TraceSpan TRACE_CONCAT(traceSpan, __LINE__)(name)
+
+#endif // TRACE_H
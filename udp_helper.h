@@ -2,6 +2,7 @@
 #define UDP_HELPER_H
 
 #include <string>
+#include <string_view>
 #include <cstring>
 #include <unistd.h>
 #include <arpa/inet.h>
@@ -10,7 +11,19 @@
 #include <fcntl.h>
 #include <iostream>
 #include <map>
+#include <mutex>
+#include <algorithm>
+#include <unordered_map>
+#include <vector>
+#include <chrono>
+#include <cstdio>
+#include <atomic>
 #include "common.h"
+#include "io_uring_backend.h"
+#include "shm_ring.h"
+#include "send_pacer.h"
+#include "busy_poll.h"
+#include "trace.h"
 
 // Structure to store client information
 struct ClientInfo {
@@ -33,12 +46,166 @@ struct ClientInfo {
     }
 };
 
+// Pack an IPv4 address and port into a single key for hash lookups
+inline uint64_t addressKey(const struct sockaddr_in& addr) {
+    return (static_cast<uint64_t>(addr.sin_addr.s_addr) << 16) | addr.sin_port;
+}
+
+// Messages of which only the newest queued copy matters. A new one
+// overwrites the queued one in place instead of being sent as well.
+enum class ReplaceKey {
+    NONE,
+    POSITION,
+    TREASURE,
+    SCORES,
+    PLAYERS,
+    COUNT
+};
+
+// Messages waiting to be packed into datagrams for one client, and the
+// pacer deciding how often and how much may go out
+struct OutboundBundle {
+    ClientInfo dest;
+    std::vector<std::string> messages;  // First `count` are queued; the rest keep their buffers for reuse
+    size_t count;
+    size_t replaceIndex[static_cast<size_t>(ReplaceKey::COUNT)];  // Queued index + 1 per key, 0 if none
+    SendPacer pacer;
+    std::string datagram;  // Packing buffer
+    uint64_t dropped;      // Messages refused because too many were queued
+    bool pending;          // Listed in UDPServer::pendingBundles
+
+    OutboundBundle(const PacerBounds& bounds = PacerBounds())
+        : dest(), messages(), count(0), replaceIndex(), pacer(bounds), datagram(), dropped(0), pending(false) {}
+};
+
+// Averages over every client's pacer, for the stats line
+struct PacingSummary {
+    size_t clients;
+    double avgIntervalMs;
+    double maxIntervalMs;
+    double avgBudgetBytes;
+    double avgSrttMs;
+    double avgLossRate;
+    uint64_t dropped;
+    RttStats rtt;  // Probe RTTs of every current session together
+
+    PacingSummary()
+        : clients(0), avgIntervalMs(0), maxIntervalMs(0), avgBudgetBytes(0),
+          avgSrttMs(0), avgLossRate(0), dropped(0), rtt() {}
+};
+
+// Probe RTTs measured over one client's session
+struct SessionRtt {
+    int playerId;
+    RttStats rtt;
+};
+
 // Helper class for UDP server operations
 class UDPServer {
 private:
     int sockfd;
     struct sockaddr_in serverAddr;
     std::map<int, ClientInfo> clients;  // Map player ID to client info
+    std::mutex clientsMutex;  // Guards clients; taken before outboxMutex when both are needed
+    std::unordered_map<uint64_t, OutboundBundle> outbox;  // Keyed by addressKey
+    std::vector<uint64_t> pendingBundles;  // Outbox keys with queued messages, so flushes skip idle clients
+    std::mutex outboxMutex;
+    size_t bundleMtu;
+    PacerBounds pacerBounds;
+    IoUringBackend* uring;  // Set when the io_uring backend is in use
+    ShardLink* shard;       // Set when running as a shard behind the gateway
+    BusyPollReceiver* busyPoller;  // Set in busy-poll mode
+    std::atomic<uint64_t> datagramsReceived;
+    std::atomic<uint64_t> datagramsSent;
+
+    // Send one datagram through the active backend. With io_uring the send
+    // may be left queued until the next submit() when deferSubmit is set.
+    bool transmit(const ClientInfo& clientInfo, const char* data, size_t len, bool deferSubmit) {
+        datagramsSent.fetch_add(1, std::memory_order_relaxed);
+
+        if (shard) {
+            return shard->send(clientInfo.addr, data, len);
+        }
+
+        if (uring && uring->queueSend(clientInfo.addr, data, len)) {
+            if (!deferSubmit) {
+                uring->submit();
+            }
+            return true;
+        }
+
+        int bytesSent = sendto(sockfd, data, len, 0,
+                              (struct sockaddr*)&clientInfo.addr, clientInfo.addrLen);
+
+        return bytesSent == static_cast<int>(len);
+    }
+
+    // Append a message to a bundle, or overwrite the queued one with the same key
+    void enqueueMessage(OutboundBundle& bundle, std::string_view message, ReplaceKey key) {
+        size_t& slot = bundle.replaceIndex[static_cast<size_t>(key)];
+        if (key != ReplaceKey::NONE && slot > 0) {
+            bundle.messages[slot - 1].assign(message.data(), message.size());
+            return;
+        }
+
+        if (bundle.count >= MAX_PENDING_MESSAGES) {
+            bundle.dropped++;
+            return;
+        }
+        if (bundle.count == bundle.messages.size()) {
+            bundle.messages.emplace_back();
+        }
+        bundle.messages[bundle.count].assign(message.data(), message.size());
+        bundle.count++;
+
+        if (key != ReplaceKey::NONE) {
+            slot = bundle.count;
+        }
+    }
+
+    // Pack queued messages into MTU-sized datagrams and send them. Unless
+    // forced, stop once the pacer's byte budget is used; the rest waits for
+    // the next flush. A lead message (the PROBE) opens the first datagram, so
+    // the budget never holds it back. Caller holds outboxMutex.
+    void flushBundle(OutboundBundle& bundle, bool force, std::string_view lead = std::string_view()) {
+        size_t sent = 0;
+        size_t bytesSent = 0;
+        bundle.datagram.assign(lead.data(), lead.size());
+
+        while (sent < bundle.count) {
+            const std::string& message = bundle.messages[sent];
+
+            if (!bundle.datagram.empty() && bundle.datagram.size() + 1 + message.size() > bundleMtu) {
+                transmit(bundle.dest, bundle.datagram.data(), bundle.datagram.size(), true);
+                bytesSent += bundle.datagram.size();
+                bundle.datagram.clear();
+
+                if (!force && bytesSent >= bundle.pacer.getBudgetBytes()) {
+                    break;
+                }
+            }
+
+            if (!bundle.datagram.empty()) {
+                bundle.datagram += '\n';
+            }
+            bundle.datagram += message;
+            sent++;
+        }
+
+        if (!bundle.datagram.empty()) {
+            transmit(bundle.dest, bundle.datagram.data(), bundle.datagram.size(), true);
+        }
+
+        // Keep what did not fit at the front, reusing the sent messages' buffers
+        if (sent < bundle.count) {
+            std::rotate(bundle.messages.begin(), bundle.messages.begin() + sent,
+                        bundle.messages.begin() + bundle.count);
+        }
+        bundle.count -= sent;
+        for (size_t& slot : bundle.replaceIndex) {
+            slot = slot > sent ? slot - sent : 0;
+        }
+    }
 
     // Set socket to non-blocking mode
     bool setNonBlocking(int sock) {
@@ -58,7 +225,21 @@ private:
     }
 
 public:
-    UDPServer(int port = DEFAULT_PORT) : sockfd(-1) {
+    UDPServer(int port = DEFAULT_PORT, size_t _bundleMtu = DEFAULT_BUNDLE_MTU, bool useIoUring = false,
+              const std::string& shardName = "")
+        : sockfd(-1), bundleMtu(std::min<size_t>(_bundleMtu, MAX_BUFFER_SIZE)), pacerBounds(), uring(nullptr),
+          shard(nullptr), busyPoller(nullptr), datagramsReceived(0), datagramsSent(0) {
+        // As a shard, datagrams come from the gateway's rings instead of a socket
+        if (!shardName.empty()) {
+            shard = new ShardLink();
+            if (!shard->attach(shardName)) {
+                std::cerr << "Error attaching to gateway rings for shard " << shardName << std::endl;
+                exit(EXIT_FAILURE);
+            }
+            std::cout << "UDP server initialized as shard " << shardName << " (shared-memory rings)" << std::endl;
+            return;
+        }
+
         // Create UDP socket
         sockfd = socket(AF_INET, SOCK_DGRAM, 0);
         if (sockfd < 0) {
@@ -85,10 +266,30 @@ public:
             exit(EXIT_FAILURE);
         }
 
-        std::cout << "UDP server initialized on port " << port << std::endl;
+        // Optional io_uring backend, falling back to select/recvfrom/sendto
+        if (useIoUring) {
+            uring = new IoUringBackend();
+            if (!uring->init(sockfd)) {
+                std::cerr << "io_uring not supported by this kernel, using select backend" << std::endl;
+                delete uring;
+                uring = nullptr;
+            }
+        }
+
+        std::cout << "UDP server initialized on port " << port;
+        if (uring) {
+            std::cout << " (io_uring backend, "
+                      << (uring->usesBufferRing() ? "provided buffer ring)" : "legacy provided buffers)");
+        } else {
+            std::cout << " (select backend)";
+        }
+        std::cout << std::endl;
     }
 
     ~UDPServer() {
+        delete busyPoller;
+        delete shard;
+        delete uring;
         if (sockfd >= 0) {
             close(sockfd);
         }
@@ -96,6 +297,31 @@ public:
 
     // Receive message with timeout
     bool receiveMessage(std::string& message, ClientInfo& clientInfo, int timeoutMs = 100) {
+        if (shard) {
+            if (shard->receive(message, clientInfo.addr, timeoutMs)) {
+                clientInfo.addrLen = sizeof(clientInfo.addr);
+                datagramsReceived.fetch_add(1, std::memory_order_relaxed);
+                return true;
+            }
+            return false;
+        }
+
+        if (uring) {
+            if (uring->receive(message, clientInfo.addr, clientInfo.addrLen, timeoutMs)) {
+                datagramsReceived.fetch_add(1, std::memory_order_relaxed);
+                return true;
+            }
+            return false;
+        }
+
+        if (busyPoller) {
+            if (busyPoller->receive(message, clientInfo.addr, clientInfo.addrLen, timeoutMs)) {
+                datagramsReceived.fetch_add(1, std::memory_order_relaxed);
+                return true;
+            }
+            return false;
+        }
+
         fd_set readfds;
         struct timeval tv;
 
@@ -118,36 +344,65 @@ public:
         }
 
         if (FD_ISSET(sockfd, &readfds)) {
-            char buffer[MAX_BUFFER_SIZE];
-            memset(buffer, 0, MAX_BUFFER_SIZE);
+            return tryReceiveMessage(message, clientInfo);
+        }
 
-            int bytesReceived = recvfrom(sockfd, buffer, MAX_BUFFER_SIZE, 0,
-                                        (struct sockaddr*)&clientInfo.addr, &clientInfo.addrLen);
+        return false;
+    }
 
-            if (bytesReceived > 0) {
-                message = std::string(buffer, bytesReceived);
+    // Receive a message only if one is already queued
+    bool tryReceiveMessage(std::string& message, ClientInfo& clientInfo) {
+        TRACE_SPAN("receive");
+        if (uring || shard) {
+            return receiveMessage(message, clientInfo, 0);
+        }
+
+        if (busyPoller) {
+            if (busyPoller->tryReceive(message, clientInfo.addr, clientInfo.addrLen)) {
+                datagramsReceived.fetch_add(1, std::memory_order_relaxed);
                 return true;
             }
+            return false;
+        }
+
+        char buffer[MAX_BUFFER_SIZE];
+
+        clientInfo.addrLen = sizeof(clientInfo.addr);
+        int bytesReceived = recvfrom(sockfd, buffer, MAX_BUFFER_SIZE, 0,
+                                    (struct sockaddr*)&clientInfo.addr, &clientInfo.addrLen);
+
+        if (bytesReceived > 0) {
+            datagramsReceived.fetch_add(1, std::memory_order_relaxed);
+            message.assign(buffer, bytesReceived);
+            return true;
         }
 
         return false;
     }
 
     // Send message to specific client
-    bool sendMessage(const ClientInfo& clientInfo, const std::string& message) {
-        int bytesSent = sendto(sockfd, message.c_str(), message.length(), 0,
-                              (struct sockaddr*)&clientInfo.addr, clientInfo.addrLen);
+    bool sendMessage(const ClientInfo& clientInfo, std::string_view message) {
+        return transmit(clientInfo, message.data(), message.size(), false);
+    }
 
-        return bytesSent == static_cast<int>(message.length());
+    // Datagram counters since startup, for stats reporting
+    uint64_t getDatagramsReceived() const {
+        return datagramsReceived.load(std::memory_order_relaxed);
+    }
+
+    uint64_t getDatagramsSent() const {
+        return datagramsSent.load(std::memory_order_relaxed);
     }
 
     // Register client
     void registerClient(int playerId, const ClientInfo& clientInfo) {
+        std::lock_guard<std::mutex> lock(clientsMutex);
         clients[playerId] = clientInfo;
     }
 
-    // Get client by player ID
+    // Get client by player ID. The pointer stays valid until removeClient.
     ClientInfo* getClient(int playerId) {
+        std::lock_guard<std::mutex> lock(clientsMutex);
         auto it = clients.find(playerId);
         if (it != clients.end()) {
             return &it->second;
@@ -155,17 +410,202 @@ public:
         return nullptr;
     }
 
-    // Remove client
+    // Remove client, sending anything still queued for it first
     void removeClient(int playerId) {
-        clients.erase(playerId);
+        std::lock_guard<std::mutex> clientsLock(clientsMutex);
+        auto it = clients.find(playerId);
+        if (it == clients.end()) {
+            return;
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(outboxMutex);
+            uint64_t key = addressKey(it->second.addr);
+            auto bundleIt = outbox.find(key);
+            if (bundleIt != outbox.end()) {
+                flushBundle(bundleIt->second, true);
+                outbox.erase(bundleIt);
+                pendingBundles.erase(std::remove(pendingBundles.begin(), pendingBundles.end(), key),
+                                     pendingBundles.end());
+                if (uring) {
+                    uring->submit();
+                }
+            }
+        }
+
+        clients.erase(it);
     }
 
     // Broadcast message to all clients
-    void broadcastMessage(const std::string& message) {
+    void broadcastMessage(std::string_view message) {
+        std::lock_guard<std::mutex> lock(clientsMutex);
         for (const auto& pair : clients) {
             sendMessage(pair.second, message);
         }
     }
+
+    // Queue a message for a client, to be packed with others up to the MTU.
+    // With a key other than NONE it replaces an unsent message with that key.
+    void queueMessage(const ClientInfo& clientInfo, std::string_view message, ReplaceKey key = ReplaceKey::NONE) {
+        std::lock_guard<std::mutex> lock(outboxMutex);
+        uint64_t bundleKey = addressKey(clientInfo.addr);
+        auto it = outbox.find(bundleKey);
+        if (it == outbox.end()) {
+            it = outbox.emplace(bundleKey, OutboundBundle(pacerBounds)).first;
+        }
+
+        OutboundBundle& bundle = it->second;
+        bundle.dest = clientInfo;
+        enqueueMessage(bundle, message, key);
+        if (!bundle.pending && bundle.count > 0) {
+            bundle.pending = true;
+            pendingBundles.push_back(bundleKey);
+        }
+    }
+
+    // Queue a message for every registered client
+    void queueBroadcast(std::string_view message, ReplaceKey key = ReplaceKey::NONE) {
+        std::lock_guard<std::mutex> lock(clientsMutex);
+        for (const auto& pair : clients) {
+            queueMessage(pair.second, message, key);
+        }
+    }
+
+    // Send pending bundles. Only clients with queued messages are visited, so
+    // the cost follows the traffic rather than the number of sessions. Each is
+    // flushed only when its pacer allows, within its byte budget, with a PROBE
+    // leading it every PROBE_INTERVAL_MS; whatever the pacer holds back
+    // stays listed for a later flush. force sends everything now (e.g. at
+    // game over).
+    void flushBundles(bool force = false) {
+        TRACE_SPAN("send");
+        auto now = std::chrono::steady_clock::now();
+        std::lock_guard<std::mutex> lock(outboxMutex);
+
+        size_t kept = 0;
+        for (uint64_t key : pendingBundles) {
+            auto it = outbox.find(key);
+            if (it == outbox.end()) {
+                continue;
+            }
+
+            OutboundBundle& bundle = it->second;
+            bundle.pacer.expireProbes(now);
+            if (force || bundle.pacer.flushDue(now)) {
+                // The probe's send time is taken now, so it must leave in this flush
+                char probeMsg[32];
+                std::string_view probe;
+                uint32_t probeSeq;
+                if (bundle.pacer.startProbe(now, probeSeq)) {
+                    int len = snprintf(probeMsg, sizeof(probeMsg), "PROBE %u", probeSeq);
+                    probe = std::string_view(probeMsg, len);
+                }
+
+                flushBundle(bundle, force, probe);
+                bundle.pacer.flushed(now);
+            }
+
+            if (bundle.count > 0) {
+                pendingBundles[kept++] = key;
+            } else {
+                bundle.pending = false;
+            }
+        }
+        pendingBundles.resize(kept);
+        if (uring) {
+            uring->submit();
+        }
+    }
+
+    // Spin on non-blocking recvmmsg instead of sleeping in select() (before
+    // any traffic). Only the plain socket backend supports it.
+    bool enableBusyPoll(int busyPollUsec) {
+        if (uring || shard) {
+            std::cerr << "Busy polling needs the select backend, keeping the current one" << std::endl;
+            return false;
+        }
+        busyPoller = new BusyPollReceiver();
+        busyPoller->init(sockfd, busyPollUsec);
+        std::cout << "Busy polling the socket with recvmmsg";
+        if (busyPollUsec > 0) {
+            std::cout << " (SO_BUSY_POLL " << busyPollUsec << "us)";
+        }
+        std::cout << std::endl;
+        return true;
+    }
+
+    // Set the limits every client's pacer adapts within (before any traffic)
+    void setPacerBounds(const PacerBounds& bounds) {
+        pacerBounds = bounds;
+    }
+
+    // Feed a client's PROBEACK to its pacer
+    void handleProbeAck(const ClientInfo& clientInfo, uint32_t seq) {
+        auto now = std::chrono::steady_clock::now();
+        std::lock_guard<std::mutex> lock(outboxMutex);
+        auto it = outbox.find(addressKey(clientInfo.addr));
+        if (it != outbox.end()) {
+            it->second.pacer.onProbeAck(seq, now);
+        }
+    }
+
+    // Current pacing across all clients
+    PacingSummary getPacingSummary() {
+        std::lock_guard<std::mutex> lock(outboxMutex);
+        PacingSummary summary;
+
+        for (const auto& pair : outbox) {
+            const SendPacer& pacer = pair.second.pacer;
+            summary.clients++;
+            summary.avgIntervalMs += pacer.getIntervalMs();
+            summary.maxIntervalMs = std::max(summary.maxIntervalMs, pacer.getIntervalMs());
+            summary.avgBudgetBytes += pacer.getBudgetBytes();
+            summary.avgSrttMs += pacer.getSrttMs();
+            summary.avgLossRate += pacer.getLossRate();
+            summary.dropped += pair.second.dropped;
+            summary.rtt.merge(pacer.getRttStats());
+        }
+
+        if (summary.clients > 0) {
+            summary.avgIntervalMs /= summary.clients;
+            summary.avgBudgetBytes /= summary.clients;
+            summary.avgSrttMs /= summary.clients;
+            summary.avgLossRate /= summary.clients;
+        }
+        return summary;
+    }
+
+    // RTT of one registered client's session so far
+    bool getSessionRtt(int playerId, RttStats& rtt) {
+        std::lock_guard<std::mutex> clientsLock(clientsMutex);
+        auto clientIt = clients.find(playerId);
+        if (clientIt == clients.end()) {
+            return false;
+        }
+
+        std::lock_guard<std::mutex> lock(outboxMutex);
+        auto it = outbox.find(addressKey(clientIt->second.addr));
+        if (it == outbox.end()) {
+            return false;
+        }
+        rtt = it->second.pacer.getRttStats();
+        return true;
+    }
+
+    // RTT of every registered client's session, by player ID
+    std::vector<SessionRtt> getSessionRtts() {
+        std::vector<SessionRtt> sessions;
+        std::lock_guard<std::mutex> clientsLock(clientsMutex);
+        std::lock_guard<std::mutex> lock(outboxMutex);
+
+        for (const auto& pair : clients) {
+            auto it = outbox.find(addressKey(pair.second.addr));
+            if (it != outbox.end()) {
+                sessions.push_back(SessionRtt{pair.first, it->second.pacer.getRttStats()});
+            }
+        }
+        return sessions;
+    }
 };
 
 // Helper class for UDP client operations
@@ -232,6 +672,25 @@ public:
         return bytesSent == static_cast<int>(message.length());
     }
 
+    // Socket descriptor, for callers that multiplex it with other inputs
+    int getSocket() const {
+        return sockfd;
+    }
+
+    // Receive a message only if one is already queued
+    bool tryReceiveMessage(std::string& message) {
+        char buffer[MAX_BUFFER_SIZE];
+
+        int bytesReceived = recvfrom(sockfd, buffer, MAX_BUFFER_SIZE, 0, NULL, NULL);
+
+        if (bytesReceived > 0) {
+            message.assign(buffer, bytesReceived);
+            return true;
+        }
+
+        return false;
+    }
+
     // Receive message with timeout
     bool receiveMessage(std::string& message, int timeoutMs = 100) {
         fd_set readfds;